@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "vulkan/vulkan.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Collects pipeline barriers, and records them as a single `pipelineBarrier`
+  ///
+  /// Barriers are merged as they are added:
+  ///  - global memory barriers become one barrier with the union of their access masks,
+  ///  - buffer barriers on overlapping or adjacent ranges of the same buffer are merged, along with any barrier the merged range then reaches,
+  ///  - image barriers on the same subresources are merged, and chained layout transitions (A to B, then B to C) become a single A to C transition.
+  /// Barriers that transfer queue family ownership are never merged.
+  /// The stage masks of the recorded barrier are the union of every added barrier's, which keeps every dependency, if conservatively.
+  ///
+  /// `flush` must be called before commands that depend on the barriers: `PrimaryCommandBuffer::beginRenderPass`,
+  /// `CommandBuffer::dispatch` and `CommandBuffer::dispatchIndirect` have overloads doing it.
+  ///
+  class BarrierBatcher
+  {
+    vk::PipelineStageFlags srcStages;
+    vk::PipelineStageFlags dstStages;
+    vk::MemoryBarrier memoryBarrier;
+    std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+    std::vector<vk::ImageMemoryBarrier> imageBarriers;
+
+    static vk::DeviceSize getEnd(vk::BufferMemoryBarrier const &barrier) noexcept
+    {
+      return barrier.size == VK_WHOLE_SIZE ? ~vk::DeviceSize(0u) : barrier.offset + barrier.size;
+    }
+
+    static bool canMerge(vk::BufferMemoryBarrier const &a, vk::BufferMemoryBarrier const &b) noexcept
+    {
+      return a.buffer == b.buffer && a.srcQueueFamilyIndex == a.dstQueueFamilyIndex && a.offset <= getEnd(b) && b.offset <= getEnd(a);
+    }
+
+  public:
+    BarrierBatcher()
+      : srcStages()
+      , dstStages()
+      , memoryBarrier()
+    {}
+
+    void addMemoryBarrier(vk::PipelineStageFlags srcStageMask,
+                          vk::PipelineStageFlags dstStageMask,
+                          vk::AccessFlags srcAccessMask,
+                          vk::AccessFlags dstAccessMask)
+    {
+      srcStages |= srcStageMask;
+      dstStages |= dstStageMask;
+      memoryBarrier.srcAccessMask |= srcAccessMask;
+      memoryBarrier.dstAccessMask |= dstAccessMask;
+    }
+
+    void addBufferBarrier(vk::PipelineStageFlags srcStageMask, vk::PipelineStageFlags dstStageMask, vk::BufferMemoryBarrier const &barrier)
+    {
+      vk::BufferMemoryBarrier merged(barrier);
+
+      srcStages |= srcStageMask;
+      dstStages |= dstStageMask;
+      // each merge widens the range, which can then reach barriers that didn't overlap it before
+      if (barrier.srcQueueFamilyIndex == barrier.dstQueueFamilyIndex)
+        for (auto it(bufferBarriers.begin()); it != bufferBarriers.end();)
+          if (canMerge(*it, merged))
+            {
+              vk::DeviceSize const end(std::max(getEnd(*it), getEnd(merged)));
+
+              merged.srcAccessMask |= it->srcAccessMask;
+              merged.dstAccessMask |= it->dstAccessMask;
+              merged.offset = std::min(it->offset, merged.offset);
+              merged.size = end == ~vk::DeviceSize(0u) ? VK_WHOLE_SIZE : end - merged.offset;
+              bufferBarriers.erase(it);
+              it = bufferBarriers.begin();
+            }
+          else
+            ++it;
+      bufferBarriers.push_back(merged);
+    }
+
+    void addImageBarrier(vk::PipelineStageFlags srcStageMask, vk::PipelineStageFlags dstStageMask, vk::ImageMemoryBarrier const &barrier)
+    {
+      srcStages |= srcStageMask;
+      dstStages |= dstStageMask;
+      if (barrier.srcQueueFamilyIndex == barrier.dstQueueFamilyIndex)
+        for (auto &batched : imageBarriers)
+          if (batched.image == barrier.image && batched.subresourceRange == barrier.subresourceRange
+              && batched.srcQueueFamilyIndex == batched.dstQueueFamilyIndex
+              && (batched.newLayout == barrier.oldLayout || (batched.oldLayout == barrier.oldLayout && batched.newLayout == barrier.newLayout)))
+            {
+              batched.srcAccessMask |= barrier.srcAccessMask;
+              batched.dstAccessMask |= barrier.dstAccessMask;
+              batched.newLayout = barrier.newLayout;
+              return;
+            }
+      imageBarriers.push_back(barrier);
+    }
+
+    bool empty() const noexcept
+    {
+      return !memoryBarrier.srcAccessMask && !memoryBarrier.dstAccessMask && bufferBarriers.empty() && imageBarriers.empty() && !srcStages
+             && !dstStages;
+    }
+
+    /// \brief Records every batched barrier in one `pipelineBarrier`, if there are any
+    void flush(vk::CommandBuffer commandBuffer)
+    {
+      if (empty())
+        return;
+
+      bool const hasMemoryBarrier(memoryBarrier.srcAccessMask || memoryBarrier.dstAccessMask);
+
+      commandBuffer.pipelineBarrier(srcStages ? srcStages : vk::PipelineStageFlagBits::eTopOfPipe,
+                                    dstStages ? dstStages : vk::PipelineStageFlagBits::eBottomOfPipe,
+                                    {},
+                                    hasMemoryBarrier ? 1u : 0u,
+                                    &memoryBarrier,
+                                    static_cast<uint32_t>(bufferBarriers.size()),
+                                    bufferBarriers.data(),
+                                    static_cast<uint32_t>(imageBarriers.size()),
+                                    imageBarriers.data());
+      srcStages = {};
+      dstStages = {};
+      memoryBarrier = vk::MemoryBarrier{};
+      bufferBarriers.clear();
+      imageBarriers.clear();
+    }
+  };
+};
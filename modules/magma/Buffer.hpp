@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+
 #include "magma/Device.hpp"
 #include "magma/Deleter.hpp"
 
@@ -23,4 +25,23 @@ namespace magma
     return Buffer<>(Deleter{magma::Device<claws::no_delete>(*this)},
                     vk::Device::createBuffer({flags, size, usage, vk::SharingMode::eExclusive, 0, nullptr}));
   }
+
+  ///
+  /// \brief Returns the offset alignment a buffer with `usage` requires for descriptors and dynamic offsets
+  ///
+  /// This is the biggest of `minUniformBufferOffsetAlignment`, `minStorageBufferOffsetAlignment` and `minTexelBufferOffsetAlignment`
+  /// that applies to `usage`.
+  ///
+  inline uint32_t getMinOffsetAlignment(vk::PhysicalDeviceLimits const &limits, vk::BufferUsageFlags usage)
+  {
+    vk::DeviceSize offsetAlignment(1u);
+
+    if (usage & vk::BufferUsageFlagBits::eUniformBuffer)
+      offsetAlignment = std::max(offsetAlignment, limits.minUniformBufferOffsetAlignment);
+    if (usage & vk::BufferUsageFlagBits::eStorageBuffer)
+      offsetAlignment = std::max(offsetAlignment, limits.minStorageBufferOffsetAlignment);
+    if (usage & (vk::BufferUsageFlagBits::eUniformTexelBuffer | vk::BufferUsageFlagBits::eStorageTexelBuffer))
+      offsetAlignment = std::max(offsetAlignment, limits.minTexelBufferOffsetAlignment);
+    return static_cast<uint32_t>(offsetAlignment);
+  }
 };
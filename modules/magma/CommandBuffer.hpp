@@ -4,6 +4,9 @@
 
 #include "vulkan/vulkan.hpp"
 
+#include "magma/BarrierBatcher.hpp"
+#include "magma/Buffer.hpp"
+#include "magma/ConditionalRendering.hpp"
 #include "magma/Deleter.hpp"
 #include "magma/Device.hpp"
 #include "magma/Framebuffer.hpp"
@@ -59,9 +62,19 @@ namespace magma
 
     using vk::CommandBuffer::pipelineBarrier;
 
+    using vk::CommandBuffer::copyBuffer;
+    using vk::CommandBuffer::copyBufferToImage;
+    using vk::CommandBuffer::fillBuffer;
+
     using vk::CommandBuffer::bindVertexBuffers;
     using vk::CommandBuffer::bindIndexBuffer;
 
+    using vk::CommandBuffer::resetQueryPool;
+    using vk::CommandBuffer::writeTimestamp;
+    using vk::CommandBuffer::beginQuery;
+    using vk::CommandBuffer::endQuery;
+    using vk::CommandBuffer::copyQueryPoolResults;
+
     using vk::CommandBuffer::setEvent;
     using vk::CommandBuffer::resetEvent;
     using vk::CommandBuffer::waitEvents;
@@ -77,66 +90,154 @@ namespace magma
     }
 
     using vk::CommandBuffer::pushConstants;
+
+    using vk::CommandBuffer::bindDescriptorSets;
+
+    void bindComputePipeline(Pipeline<claws::no_delete> pipeline) const
+    {
+      vk::CommandBuffer::bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    }
+
+    /// \brief Dispatches compute work groups, with the bound compute pipeline, outside of any render pass
+    void dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) const
+    {
+      vk::CommandBuffer::dispatch(groupCountX, groupCountY, groupCountZ);
+    }
+
+    /// \brief Same as `dispatch`, with the group counts read from `buffer` at `offset`, as a `vk::DispatchIndirectCommand`
+    void dispatchIndirect(Buffer<claws::no_delete> buffer, vk::DeviceSize offset) const
+    {
+      vk::CommandBuffer::dispatchIndirect(buffer, offset);
+    }
+
+    /// \brief Records the barriers batched in `barriers` before dispatching, so that the dispatch sees them
+    void dispatch(BarrierBatcher &barriers, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) const
+    {
+      barriers.flush(*this);
+      dispatch(groupCountX, groupCountY, groupCountZ);
+    }
+
+    /// \brief Records the barriers batched in `barriers` before dispatching, so that the dispatch and its indirect read see them
+    void dispatchIndirect(BarrierBatcher &barriers, Buffer<claws::no_delete> buffer, vk::DeviceSize offset) const
+    {
+      barriers.flush(*this);
+      dispatchIndirect(buffer, offset);
+    }
   };
 
-  class SecondaryCommandBuffer : public CommandBuffer
+  class PrimaryCommandBuffer;
+
+  class SecondaryCommandBuffer;
+
+  ///
+  /// \brief Keeps rendering conditional until destroyed, see `RenderPassCommands::beginConditionalRendering`
+  ///
+  class ConditionalRenderingLock
   {
+    friend struct RenderPassCommands;
+
+    vk::CommandBuffer commandBuffer;
+    ConditionalRendering const *conditionalRendering;
+
+    ConditionalRenderingLock(vk::CommandBuffer commandBuffer, ConditionalRendering const &conditionalRendering)
+      : commandBuffer(commandBuffer)
+      , conditionalRendering(&conditionalRendering)
+    {}
+
   public:
-    using CommandBuffer::CommandBuffer;
+    ConditionalRenderingLock(ConditionalRenderingLock const &) = delete;
 
-    void begin(vk::CommandBufferUsageFlags flags, vk::CommandBufferInheritanceInfo const &pInheritanceInfo) const
+    ConditionalRenderingLock(ConditionalRenderingLock &&other)
+      : commandBuffer(other.commandBuffer)
+      , conditionalRendering(other.conditionalRendering)
     {
-      vk::CommandBuffer::begin(vk::CommandBufferBeginInfo{flags, &pInheritanceInfo});
+      other.commandBuffer = nullptr;
     }
-  };
 
-  class PrimaryCommandBuffer;
+    ConditionalRenderingLock &operator=(ConditionalRenderingLock const &) = delete;
+    ConditionalRenderingLock &operator=(ConditionalRenderingLock &&) = delete;
+
+    ~ConditionalRenderingLock()
+    {
+      if (commandBuffer)
+        conditionalRendering->end(commandBuffer);
+    }
+  };
 
-  struct RenderPassExecLock
+  ///
+  /// \brief The commands that can be recorded inside a render pass
+  ///
+  /// Shared by `RenderPassExecLock`, and by secondary command buffers continuing a render pass.
+  ///
+  struct RenderPassCommands
   {
   protected:
     vk::CommandBuffer commandBuffer;
 
-    friend class PrimaryCommandBuffer;
+    friend class SecondaryCommandBuffer;
 
-    RenderPassExecLock(vk::CommandBuffer commandBuffer)
+    RenderPassCommands(vk::CommandBuffer commandBuffer)
       : commandBuffer(commandBuffer)
     {}
 
   public:
-    RenderPassExecLock()
+    RenderPassCommands()
       : commandBuffer(nullptr)
     {}
 
-    RenderPassExecLock(RenderPassExecLock const &) = delete;
-
-    RenderPassExecLock(RenderPassExecLock &&other)
-      : commandBuffer(other.commandBuffer)
+    void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) const
     {
-      other.commandBuffer = nullptr;
+      commandBuffer.draw(vertexCount, instanceCount, firstVertex, firstInstance);
     }
 
-    auto &operator=(RenderPassExecLock other)
+    void drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t vertexOffset, uint32_t firstIndex, uint32_t firstInstance) const
     {
-      using std::swap;
+      commandBuffer.drawIndexed(indexCount, instanceCount, vertexOffset, firstIndex, firstInstance);
+    }
 
-      swap(commandBuffer, other.commandBuffer);
-      return *this;
+    ///
+    /// \brief Draws with arguments read from `buffer` at `offset`, as `drawCount` `vk::DrawIndirectCommand` spaced by `stride`
+    ///
+    /// A `drawCount` above 1 requires the `multiDrawIndirect` feature.
+    ///
+    void drawIndirect(Buffer<claws::no_delete> buffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride = sizeof(vk::DrawIndirectCommand)) const
+    {
+      commandBuffer.drawIndirect(buffer, offset, drawCount, stride);
     }
 
-    void next(vk::SubpassContents contents) const
+    /// \brief Same as `drawIndirect`, with `vk::DrawIndexedIndirectCommand` arguments
+    void drawIndexedIndirect(Buffer<claws::no_delete> buffer,
+                             vk::DeviceSize offset,
+                             uint32_t drawCount,
+                             uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand)) const
     {
-      commandBuffer.nextSubpass(contents);
+      commandBuffer.drawIndexedIndirect(buffer, offset, drawCount, stride);
     }
 
-    void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) const
+    ///
+    /// \brief Same as `drawIndirect`, with the draw count read from `countBuffer` at `countOffset`, and capped to `maxDrawCount`
+    ///
+    /// Lets the GPU produce the number of draws, e.g. after culling. Requires Vulkan 1.2 and the `drawIndirectCount` feature.
+    ///
+    void drawIndirectCount(Buffer<claws::no_delete> buffer,
+                           vk::DeviceSize offset,
+                           Buffer<claws::no_delete> countBuffer,
+                           vk::DeviceSize countOffset,
+                           uint32_t maxDrawCount,
+                           uint32_t stride = sizeof(vk::DrawIndirectCommand)) const
     {
-      commandBuffer.draw(vertexCount, instanceCount, firstVertex, firstInstance);
+      commandBuffer.drawIndirectCount(buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
     }
 
-    void drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t vertexOffset, uint32_t firstIndex, uint32_t firstInstance) const
+    /// \brief Same as `drawIndirectCount`, with `vk::DrawIndexedIndirectCommand` arguments
+    void drawIndexedIndirectCount(Buffer<claws::no_delete> buffer,
+                                  vk::DeviceSize offset,
+                                  Buffer<claws::no_delete> countBuffer,
+                                  vk::DeviceSize countOffset,
+                                  uint32_t maxDrawCount,
+                                  uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand)) const
     {
-      commandBuffer.drawIndexed(indexCount, instanceCount, vertexOffset, firstIndex, firstInstance);
+      commandBuffer.drawIndexedIndirectCount(buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
     }
 
     void bindGraphicsPipeline(Pipeline<claws::no_delete> pipeline) const
@@ -144,6 +245,88 @@ namespace magma
       commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
     }
 
+    void writeTimestamp(vk::PipelineStageFlagBits pipelineStage, claws::handle<vk::QueryPool, claws::no_delete> queryPool, uint32_t query) const
+    {
+      commandBuffer.writeTimestamp(pipelineStage, queryPool, query);
+    }
+
+    void beginQuery(claws::handle<vk::QueryPool, claws::no_delete> queryPool, uint32_t query, vk::QueryControlFlags flags) const
+    {
+      commandBuffer.beginQuery(queryPool, query, flags);
+    }
+
+    void endQuery(claws::handle<vk::QueryPool, claws::no_delete> queryPool, uint32_t query) const
+    {
+      commandBuffer.endQuery(queryPool, query);
+    }
+
+    ///
+    /// \brief Makes the following draws depend on the `uint32_t` at `offset` in `buffer`: they are discarded if it is 0, or if it isn't when `inverted`
+    ///
+    /// Rendering stays conditional until the returned lock is destroyed, which must happen in the same subpass.
+    /// `buffer` must be created with `vk::BufferUsageFlagBits::eConditionalRenderingEXT`, and `offset` must be a multiple of 4.
+    ///
+    auto beginConditionalRendering(ConditionalRendering const &conditionalRendering,
+                                   Buffer<claws::no_delete> buffer,
+                                   vk::DeviceSize offset,
+                                   bool inverted = false) const
+    {
+      conditionalRendering.begin(
+        commandBuffer, buffer, offset, inverted ? vk::ConditionalRenderingFlagBitsEXT::eInverted : vk::ConditionalRenderingFlagsEXT{});
+      return ConditionalRenderingLock{commandBuffer, conditionalRendering};
+    }
+  };
+
+  class SecondaryCommandBuffer : public CommandBuffer
+  {
+  public:
+    using CommandBuffer::CommandBuffer;
+
+    void begin(vk::CommandBufferUsageFlags flags, vk::CommandBufferInheritanceInfo const &pInheritanceInfo) const
+    {
+      vk::CommandBuffer::begin(vk::CommandBufferBeginInfo{flags, &pInheritanceInfo});
+    }
+
+    /// \brief Gives access to draw commands, for a command buffer begun with `vk::CommandBufferUsageFlagBits::eRenderPassContinue`
+    auto continueRenderPass()
+    {
+      return RenderPassCommands{raw()};
+    }
+  };
+
+  struct RenderPassExecLock : public RenderPassCommands
+  {
+  protected:
+    friend class PrimaryCommandBuffer;
+
+    RenderPassExecLock(vk::CommandBuffer commandBuffer)
+      : RenderPassCommands(commandBuffer)
+    {}
+
+  public:
+    RenderPassExecLock() = default;
+
+    RenderPassExecLock(RenderPassExecLock const &) = delete;
+
+    RenderPassExecLock(RenderPassExecLock &&other)
+      : RenderPassCommands(other.commandBuffer)
+    {
+      other.commandBuffer = nullptr;
+    }
+
+    auto &operator=(RenderPassExecLock other)
+    {
+      using std::swap;
+
+      swap(commandBuffer, other.commandBuffer);
+      return *this;
+    }
+
+    void next(vk::SubpassContents contents) const
+    {
+      commandBuffer.nextSubpass(contents);
+    }
+
     ~RenderPassExecLock()
     {
       commandBuffer.endRenderPass();
@@ -165,6 +348,11 @@ namespace magma
       vk::CommandBuffer::executeCommands(static_cast<std::vector<vk::CommandBuffer> const &>(secondaryCommands));
     }
 
+    void execBuffers(std::vector<vk::CommandBuffer> const &secondaryCommands) const
+    {
+      vk::CommandBuffer::executeCommands(secondaryCommands);
+    }
+
     auto beginRenderPass(RenderPass<claws::no_delete> renderpass,
                          Framebuffer<claws::no_delete> framebuffer,
                          vk::Rect2D renderArea,
@@ -175,6 +363,18 @@ namespace magma
 
       return RenderPassExecLock{*this};
     }
+
+    /// \brief Records the barriers batched in `barriers` before beginning the render pass, so that its draws see them
+    auto beginRenderPass(BarrierBatcher &barriers,
+                         RenderPass<claws::no_delete> renderpass,
+                         Framebuffer<claws::no_delete> framebuffer,
+                         vk::Rect2D renderArea,
+                         std::vector<vk::ClearValue> const &clearValues,
+                         vk::SubpassContents contents) const
+    {
+      barriers.flush(*this);
+      return beginRenderPass(renderpass, framebuffer, renderArea, clearValues, contents);
+    }
   };
 
   namespace impl
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "magma/CommandBuffer.hpp"
+#include "magma/Fence.hpp"
+#include "magma/ThreadLocal.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Hands out command buffers from a pool per thread and per frame in flight
+  ///
+  /// Vulkan pools are externally synchronized, so each recording thread gets its own pool for every frame slot, created on first use.
+  /// Command buffers are never freed: when a thread first asks for one in a new frame, its pool for that slot is reset with a single `resetCommandPool`,
+  /// and the command buffers it already allocated are handed out again.
+  /// `nextFrame` waits for the fence of the slot it moves to, so a pool is only ever reset once the GPU is done with it.
+  ///
+  /// Getting command buffers is thread-safe, but `nextFrame` must not be called while other threads are recording.
+  ///
+  class CommandPoolManager
+  {
+    struct ThreadPool
+    {
+      CommandPool<> commandPool;
+      std::vector<vk::CommandBuffer> primaryCommandBuffers;
+      std::vector<vk::CommandBuffer> secondaryCommandBuffers;
+      std::size_t usedPrimaryCount;
+      std::size_t usedSecondaryCount;
+      uint64_t frameNumber;
+    };
+
+    struct ThreadState
+    {
+      std::vector<ThreadPool> frames;
+    };
+
+    Device<claws::no_delete> device;
+    uint32_t queueFamilyIndex;
+    std::vector<vk::Fence> frameFences;
+    uint32_t currentFrame;
+    uint64_t frameNumber;
+    impl::ThreadLocal<ThreadState> threadStates;
+
+    ThreadPool &getThreadPool()
+    {
+      ThreadState &threadState(threadStates.get());
+
+      if (threadState.frames.empty())
+        threadState.frames.resize(frameFences.size());
+
+      ThreadPool &threadPool(threadState.frames[currentFrame]);
+
+      if (!threadPool.commandPool)
+        threadPool.commandPool = device.createCommandPool(vk::CommandPoolCreateFlagBits::eTransient, queueFamilyIndex);
+      else if (threadPool.frameNumber != frameNumber)
+        device.resetCommandPool(threadPool.commandPool, {});
+      if (threadPool.frameNumber != frameNumber)
+        {
+          threadPool.usedPrimaryCount = 0u;
+          threadPool.usedSecondaryCount = 0u;
+          threadPool.frameNumber = frameNumber;
+        }
+      return threadPool;
+    }
+
+    vk::CommandBuffer getCommandBuffer(vk::CommandPool commandPool,
+                                       std::vector<vk::CommandBuffer> &commandBuffers,
+                                       std::size_t &usedCount,
+                                       vk::CommandBufferLevel level)
+    {
+      if (usedCount == commandBuffers.size())
+        {
+          uint32_t const count(static_cast<uint32_t>(std::max(commandBuffers.size(), std::size_t(1u))));
+          auto const newCommandBuffers(device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{commandPool, level, count}));
+
+          commandBuffers.insert(commandBuffers.end(), newCommandBuffers.begin(), newCommandBuffers.end());
+        }
+      return commandBuffers[usedCount++];
+    }
+
+  public:
+    CommandPoolManager(Device<claws::no_delete> device, uint32_t queueFamilyIndex, uint32_t frameCount)
+      : device(device)
+      , queueFamilyIndex(queueFamilyIndex)
+      , frameFences(frameCount)
+      , currentFrame(0u)
+      , frameNumber(1u)
+      , threadStates()
+    {}
+
+    CommandPoolManager(CommandPoolManager const &) = delete;
+    CommandPoolManager(CommandPoolManager &&) = delete;
+
+    CommandPoolManager &operator=(CommandPoolManager const &) = delete;
+    CommandPoolManager &operator=(CommandPoolManager &&) = delete;
+
+    /// \brief Returns a primary command buffer for the calling thread, valid until the current frame slot comes around again
+    PrimaryCommandBuffer getPrimaryCommandBuffer()
+    {
+      ThreadPool &threadPool(getThreadPool());
+
+      return PrimaryCommandBuffer(
+        getCommandBuffer(threadPool.commandPool, threadPool.primaryCommandBuffers, threadPool.usedPrimaryCount, vk::CommandBufferLevel::ePrimary));
+    }
+
+    /// \brief Returns a secondary command buffer for the calling thread, valid until the current frame slot comes around again
+    SecondaryCommandBuffer getSecondaryCommandBuffer()
+    {
+      ThreadPool &threadPool(getThreadPool());
+
+      return SecondaryCommandBuffer(
+        getCommandBuffer(threadPool.commandPool, threadPool.secondaryCommandBuffers, threadPool.usedSecondaryCount, vk::CommandBufferLevel::eSecondary));
+    }
+
+    ///
+    /// \brief Ends the current frame, whose submissions signal `fence`, and moves to the next frame slot
+    ///
+    /// Waits for the fence the next slot was ended with, so that its pools can be reset.
+    /// Fences must not be reset before the manager comes back to their slot.
+    ///
+    void nextFrame(Fence<claws::no_delete> fence)
+    {
+      frameFences[currentFrame] = fence;
+      currentFrame = (currentFrame + 1) % static_cast<uint32_t>(frameFences.size());
+      ++frameNumber;
+      if (frameFences[currentFrame])
+        device.waitForFences({frameFences[currentFrame]}, true, ~0ull);
+    }
+
+    uint32_t getCurrentFrame() const noexcept
+    {
+      return currentFrame;
+    }
+  };
+};
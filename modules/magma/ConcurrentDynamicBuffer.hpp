@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <vector>
+
+#include "magma/DynamicBuffer.hpp"
+#include "magma/ThreadLocal.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief A `DynamicBuffer` that can be used from many threads at once
+  ///
+  /// Small ranges are rounded up to a power of two size class and served from a cache owned by the calling thread,
+  /// which is refilled from, and trimmed back to, the shared `DynamicBuffer` a batch at a time, so the shared lock is rarely taken.
+  /// A range can be freed from any thread: it goes to the freeing thread's cache, as ranges of a size class are interchangeable.
+  /// When a thread exits, the ranges its cache holds go back to the shared buffer.
+  /// Chunks are always persistently mapped, so that `getMemory` never maps memory another thread may be accessing.
+  ///
+  class ConcurrentDynamicBuffer
+  {
+  public:
+    using RangeId = DynamicBuffer::RangeId;
+
+    static constexpr RangeId nullId{DynamicBuffer::nullId};
+
+  private:
+    static constexpr unsigned minClassLog2{4u};
+    static constexpr unsigned maxClassLog2{16u};
+    static constexpr unsigned classCount{maxClassLog2 - minClassLog2 + 1u};
+    /// bytes moved between a thread's cache and the shared buffer at once
+    static constexpr uint32_t batchSize{1u << 16u};
+    static constexpr uint32_t maxBatchCount{64u};
+
+    struct Cache
+    {
+      std::array<std::vector<RangeId>, classCount> freeRanges;
+    };
+
+    DynamicBuffer pool;
+    std::mutex poolMutex;
+    uint32_t cacheAlignment;
+    impl::ThreadLocal<Cache> caches;
+
+    static unsigned getSizeClass(vk::DeviceSize size) noexcept
+    {
+      return size <= (1u << minClassLog2) ? 0u : impl::findLastSet(size - 1u) + 1u - minClassLog2;
+    }
+
+    static uint32_t getBatchCount(unsigned sizeClass) noexcept
+    {
+      return std::clamp(batchSize >> (sizeClass + minClassLog2), 1u, maxBatchCount);
+    }
+
+    Cache &getCache()
+    {
+      return caches.get();
+    }
+
+    void refill(std::vector<RangeId> &freeRanges, unsigned sizeClass)
+    {
+      uint32_t const size(1u << (sizeClass + minClassLog2));
+      uint32_t const batchCount(getBatchCount(sizeClass));
+      std::lock_guard<std::mutex> lock(poolMutex);
+
+      freeRanges.push_back(pool.allocate(size, cacheAlignment));
+      try
+        {
+          while (freeRanges.size() < batchCount)
+            freeRanges.push_back(pool.allocate(size, cacheAlignment));
+        }
+      catch (...)
+        {
+          // running out of memory midway still leaves the range we need
+        }
+    }
+
+    void addToCache(RangeId index, unsigned sizeClass)
+    {
+      auto &freeRanges(getCache().freeRanges[sizeClass]);
+
+      freeRanges.push_back(index);
+      if (freeRanges.size() > 2 * getBatchCount(sizeClass))
+        trim(freeRanges, getBatchCount(sizeClass));
+    }
+
+    void trim(std::vector<RangeId> &freeRanges, std::size_t keptCount)
+    {
+      if (freeRanges.size() <= keptCount)
+        return;
+
+      std::lock_guard<std::mutex> lock(poolMutex);
+
+      for (auto it(freeRanges.begin() + keptCount); it != freeRanges.end(); ++it)
+        pool.free(*it);
+      freeRanges.resize(keptCount);
+    }
+
+  public:
+    ConcurrentDynamicBuffer(Device<claws::no_delete> device,
+                            vk::PhysicalDevice physicalDevice,
+                            vk::BufferCreateFlags createFlags,
+                            vk::BufferUsageFlags usage,
+                            vk::MemoryPropertyFlags memoryFlags,
+                            std::optional<std::vector<uint32_t>> &&queueFamilies = {})
+      : pool(device, physicalDevice, createFlags, usage, memoryFlags, std::move(queueFamilies), DynamicBuffer::MappingMode::persistent)
+      , cacheAlignment(std::max(pool.getOffsetAlignment(), uint32_t(1u << minClassLog2)))
+      , caches([this](Cache &cache) {
+        for (auto &freeRanges : cache.freeRanges)
+          trim(freeRanges, 0u);
+      })
+    {}
+
+    ConcurrentDynamicBuffer(ConcurrentDynamicBuffer const &) = delete;
+    ConcurrentDynamicBuffer(ConcurrentDynamicBuffer &&) = delete;
+
+    ConcurrentDynamicBuffer &operator=(ConcurrentDynamicBuffer const &) = delete;
+    ConcurrentDynamicBuffer &operator=(ConcurrentDynamicBuffer &&) = delete;
+
+    uint32_t getOffsetAlignment() const noexcept
+    {
+      return pool.getOffsetAlignment();
+    }
+
+    RangeId allocate(vk::DeviceSize size)
+    {
+      return allocate(size, 1u);
+    }
+
+    ///
+    /// \brief Allocates a range whose offset in its buffer is a multiple of `alignment`
+    ///
+    /// Ranges that fit a size class and need no more than `getOffsetAlignment` (or 16 bytes) of alignment come from the calling thread's cache,
+    /// others are allocated directly from the shared buffer.
+    ///
+    RangeId allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+    {
+      unsigned const sizeClass(getSizeClass(size));
+
+      if (sizeClass >= classCount || alignment > cacheAlignment)
+        {
+          std::lock_guard<std::mutex> lock(poolMutex);
+
+          return pool.allocate(size, alignment);
+        }
+
+      auto &freeRanges(getCache().freeRanges[sizeClass]);
+
+      if (freeRanges.empty())
+        refill(freeRanges, sizeClass);
+
+      RangeId const range(freeRanges.back());
+
+      freeRanges.pop_back();
+      return range;
+    }
+
+    ///
+    /// \brief Frees a range, from any thread, looking its size up in the shared buffer
+    ///
+    /// A range that is aligned for the cache goes to the calling thread's cache of the biggest size class it holds,
+    /// others go back to the shared buffer.
+    /// Looking the size up takes the shared lock, which the overload taking the size avoids.
+    ///
+    void free(RangeId index)
+    {
+      if (index == nullId)
+        return;
+
+      vk::DeviceSize const size(getSize(index));
+
+      if (size < (vk::DeviceSize(1u) << minClassLog2) || size >= (vk::DeviceSize(2u) << maxClassLog2) || index.second % cacheAlignment)
+        {
+          std::lock_guard<std::mutex> lock(poolMutex);
+
+          pool.free(index);
+          return;
+        }
+      addToCache(index, impl::findLastSet(size) - minClassLog2);
+    }
+
+    ///
+    /// \brief Frees a range, from any thread
+    ///
+    /// `size` and `alignment` must be the ones the range was allocated with, they tell which cache the range belongs in.
+    ///
+    void free(RangeId index, vk::DeviceSize size, vk::DeviceSize alignment = 1u)
+    {
+      if (index == nullId)
+        return;
+
+      unsigned const sizeClass(getSizeClass(size));
+
+      if (sizeClass >= classCount || alignment > cacheAlignment)
+        {
+          std::lock_guard<std::mutex> lock(poolMutex);
+
+          pool.free(index);
+          return;
+        }
+      addToCache(index, sizeClass);
+    }
+
+    /// \brief Gives every range cached by the calling thread back to the shared buffer, which also happens when the thread exits
+    void trimThreadCache()
+    {
+      for (auto &freeRanges : getCache().freeRanges)
+        trim(freeRanges, 0u);
+    }
+
+    /// \brief See `DynamicBuffer::getMemory`
+    template<class PtrType>
+    auto getMemory(RangeId index)
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+
+      return pool.getMemory<PtrType>(index);
+    }
+
+    magma::Buffer<claws::no_delete> getBuffer(RangeId index)
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+
+      return pool.getBuffer(index);
+    }
+
+    /// \brief See `DynamicBuffer::getSize`
+    vk::DeviceSize getSize(RangeId index)
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+
+      return pool.getSize(index);
+    }
+  };
+};
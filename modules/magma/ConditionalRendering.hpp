@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdexcept>
+
+#include "magma/Device.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief The `VK_EXT_conditional_rendering` commands, loaded from a device
+  ///
+  /// The loader doesn't export extension commands, so they are fetched with `getProcAddr`.
+  /// The device must be created with `extensionName` enabled, and the `conditionalRendering` feature.
+  ///
+  class ConditionalRendering
+  {
+    PFN_vkCmdBeginConditionalRenderingEXT beginFunction;
+    PFN_vkCmdEndConditionalRenderingEXT endFunction;
+
+  public:
+    static constexpr char const *extensionName = VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME;
+
+    ConditionalRendering(Device<claws::no_delete> device)
+      : beginFunction(reinterpret_cast<PFN_vkCmdBeginConditionalRenderingEXT>(device.getProcAddr("vkCmdBeginConditionalRenderingEXT")))
+      , endFunction(reinterpret_cast<PFN_vkCmdEndConditionalRenderingEXT>(device.getProcAddr("vkCmdEndConditionalRenderingEXT")))
+    {
+      if (!beginFunction || !endFunction)
+        throw std::runtime_error("VK_EXT_conditional_rendering is not enabled on the device");
+    }
+
+    void begin(vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::DeviceSize offset, vk::ConditionalRenderingFlagsEXT flags) const
+    {
+      vk::ConditionalRenderingBeginInfoEXT const beginInfo{buffer, offset, flags};
+
+      beginFunction(static_cast<VkCommandBuffer>(commandBuffer), &static_cast<VkConditionalRenderingBeginInfoEXT const &>(beginInfo));
+    }
+
+    void end(vk::CommandBuffer commandBuffer) const
+    {
+      endFunction(static_cast<VkCommandBuffer>(commandBuffer));
+    }
+  };
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "magma/Deleter.hpp"
+#include "magma/Fence.hpp"
+#include "magma/TimelineSemaphore.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Keeps objects the GPU may still use alive until it is done with them, then destroys them in bulk
+  ///
+  /// Retired objects go into the current bucket, which `endFrame` closes with the fence or timeline value the frame's last submission signals.
+  /// `collect` destroys the content of every bucket the GPU has passed, in the order they were closed.
+  /// Any movable object can be retired, handles are destroyed through their own deleter.
+  /// Retiring is thread-safe, so `DeferredDeleter` can be used from any thread.
+  ///
+  /// The queue destroys whatever it still holds when destroyed, so the device must be idle by then.
+  ///
+  class DeletionQueue
+  {
+    struct Retired
+    {
+      virtual ~Retired() = default;
+    };
+
+    template<class T>
+    struct RetiredObject final : public Retired
+    {
+      T object;
+
+      RetiredObject(T &&object)
+        : object(std::move(object))
+      {}
+    };
+
+    template<class Deleter, class T>
+    struct RetiredHandle final : public Retired
+    {
+      Deleter deleter;
+      T object;
+
+      RetiredHandle(Deleter const &deleter, T const &object)
+        : deleter(deleter)
+        , object(object)
+      {}
+
+      ~RetiredHandle() override
+      {
+        deleter(object);
+      }
+    };
+
+    struct Bucket
+    {
+      vk::Fence fence;
+      uint64_t value;
+      std::vector<std::unique_ptr<Retired>> objects;
+    };
+
+    Device<claws::no_delete> device;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Retired>> current;
+    std::deque<Bucket> buckets;
+
+    void push(std::unique_ptr<Retired> &&retired)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      current.push_back(std::move(retired));
+    }
+
+    /// collects buckets in order, up to the first one not passed, stepping over timeline buckets if `skipsTimelineBuckets`
+    template<class IsPassed>
+    void collectIf(IsPassed isPassed, bool skipsTimelineBuckets = false)
+    {
+      std::vector<std::unique_ptr<Retired>> destroyed;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto bucket(buckets.begin()); bucket != buckets.end();)
+          if (skipsTimelineBuckets && !bucket->fence)
+            ++bucket;
+          else if (isPassed(*bucket))
+            {
+              std::move(bucket->objects.begin(), bucket->objects.end(), std::back_inserter(destroyed));
+              bucket = buckets.erase(bucket);
+            }
+          else
+            break;
+      }
+      // destroyed outside of the lock, in case a deleter retires something else
+    }
+
+  public:
+    DeletionQueue(Device<claws::no_delete> device)
+      : device(device)
+    {}
+
+    DeletionQueue(DeletionQueue const &) = delete;
+    DeletionQueue(DeletionQueue &&) = delete;
+
+    DeletionQueue &operator=(DeletionQueue const &) = delete;
+    DeletionQueue &operator=(DeletionQueue &&) = delete;
+
+    /// \brief Takes ownership of `object`, which is destroyed once the GPU has passed the end of the current frame
+    template<class T>
+    void retire(T &&object)
+    {
+      static_assert(!std::is_lvalue_reference_v<T>, "retired objects must be moved in");
+      push(std::make_unique<RetiredObject<T>>(std::move(object)));
+    }
+
+    /// \brief Schedules `deleter(object)`, for raw objects that aren't owned by a handle
+    template<class Deleter, class T>
+    void retire(Deleter const &deleter, T const &object)
+    {
+      push(std::make_unique<RetiredHandle<Deleter, T>>(deleter, object));
+    }
+
+    ///
+    /// \brief Closes the current bucket, to be collected once `fence` is signaled
+    ///
+    /// `fence` must be signaled by a submission made after every use of the retired objects, and not be reset before it has been collected.
+    ///
+    void endFrame(Fence<claws::no_delete> fence)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      buckets.push_back({fence, 0u, std::move(current)});
+      current.clear();
+    }
+
+    /// \brief Closes the current bucket, to be collected once a timeline reaches `value`
+    void endFrame(uint64_t value)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      buckets.push_back({nullptr, value, std::move(current)});
+      current.clear();
+    }
+
+    ///
+    /// \brief Destroys the content of the buckets whose fence is signaled
+    ///
+    /// Buckets closed with a timeline value are left for the other overloads, without holding back the fence buckets closed after them.
+    ///
+    void collect()
+    {
+      collectIf([this](Bucket const &bucket) { return device.getFenceStatus(bucket.fence) == vk::Result::eSuccess; }, true);
+    }
+
+    /// \brief Destroys the content of the buckets whose fence is signaled, or whose timeline value is at most `completedValue`
+    void collect(uint64_t completedValue)
+    {
+      collectIf([this, completedValue](Bucket const &bucket) {
+        return bucket.fence ? device.getFenceStatus(bucket.fence) == vk::Result::eSuccess : bucket.value <= completedValue;
+      });
+    }
+
+    /// \brief Same as `collect(completedValue)`, with the current value of `timeline`
+    void collect(TimelineSemaphore const &timeline)
+    {
+      collect(timeline.getValue());
+    }
+
+    /// \brief Destroys everything, without checking the GPU: only call this once the device is idle
+    void clear()
+    {
+      collectIf([](Bucket const &) { return true; });
+
+      std::vector<std::unique_ptr<Retired>> destroyed;
+      std::lock_guard<std::mutex> lock(mutex);
+
+      destroyed.swap(current);
+    }
+  };
+
+  ///
+  /// \brief Deleter policy handing objects to a `DeletionQueue` instead of destroying them right away
+  ///
+  /// `Deleter` is the deleter that eventually destroys the object, e.g. `magma::Deleter` or `DeviceMemoryDeleter`.
+  /// Without a queue, objects are destroyed right away, so a default constructed `DeferredDeleter` does nothing, like the deleter it wraps.
+  ///
+  template<class Deleter = magma::Deleter>
+  struct DeferredDeleter
+  {
+    DeletionQueue *deletionQueue;
+    Deleter deleter;
+
+    template<class T>
+    void operator()(T const &obj) const
+    {
+      if (deletionQueue)
+        deletionQueue->retire(deleter, obj);
+      else
+        deleter(obj);
+    }
+  };
+};
@@ -5,6 +5,8 @@
 
 namespace magma
 {
+  class MemoryTypeSelector;
+
   namespace impl
   {
     class Device : public vk::Device
@@ -17,22 +19,29 @@ namespace magma
         : vk::Device(nullptr)
       {}
 
+      /// `next` is chained to the `vk::DeviceCreateInfo`, e.g. to enable features of later versions with `vk::PhysicalDeviceVulkan12Features`
       Device(vk::PhysicalDevice physicalDevice,
              std::vector<vk::DeviceQueueCreateInfo> const &deviceQueueCreateInfos,
-             std::vector<char const *> const &extensions = {})
+             std::vector<char const *> const &extensions = {},
+             vk::PhysicalDeviceFeatures const &enabledFeatures = {},
+             void const *next = nullptr)
         : vk::Device([](vk::PhysicalDevice physicalDevice,
                         std::vector<vk::DeviceQueueCreateInfo> const &deviceQueueCreateInfos,
-                        std::vector<char const *> const &extensions) {
+                        std::vector<char const *> const &extensions,
+                        vk::PhysicalDeviceFeatures const &enabledFeatures,
+                        void const *next) {
           vk::DeviceCreateInfo deviceCreateInfo{{},
                                                 static_cast<unsigned>(deviceQueueCreateInfos.size()),
                                                 deviceQueueCreateInfos.data(),
                                                 0,
                                                 nullptr,
                                                 static_cast<unsigned>(extensions.size()),
-                                                extensions.data()};
+                                                extensions.data(),
+                                                &enabledFeatures};
 
+          deviceCreateInfo.pNext = next;
           return physicalDevice.createDevice(deviceCreateInfo);
-        }(physicalDevice, deviceQueueCreateInfos, extensions))
+        }(physicalDevice, deviceQueueCreateInfos, extensions, enabledFeatures, next))
       {}
 
 
@@ -66,6 +75,8 @@ namespace magma
 
       auto createSemaphore() const;
 
+      auto createTimelineSemaphore(uint64_t initialValue) const;
+
       auto createEvenv() const;
 
       using vk::Device::getEventStatus;
@@ -74,6 +85,12 @@ namespace magma
 
       auto createPipeline(vk::GraphicsPipelineCreateInfo const &createInfo) const;
 
+      auto createComputePipeline(vk::ComputePipelineCreateInfo const &createInfo) const;
+
+      auto createQueryPool(vk::QueryType queryType, uint32_t queryCount, vk::QueryPipelineStatisticFlags pipelineStatistics = {}) const;
+
+      using vk::Device::getQueryPoolResults;
+
       auto createRenderPass(vk::RenderPassCreateInfo const &renderPassCreateInfo) const;
 
       auto getRenderAreaGranularity(claws::handle<vk::RenderPass, claws::no_delete> renderPass) const;
@@ -114,11 +131,20 @@ namespace magma
                             vk::DeviceSize offset,
                             vk::DeviceSize size) const;
 
-      auto createDeviceMemory(vk::DeviceSize size, uint32_t typeIndex) const;
+      auto createDeviceMemory(vk::DeviceSize size, uint32_t typeIndex, MemoryTypeSelector *memoryTypeSelector = nullptr) const;
+      auto createDedicatedDeviceMemory(vk::DeviceSize size, uint32_t typeIndex, vk::Buffer buffer, MemoryTypeSelector *memoryTypeSelector = nullptr) const;
+      auto createDedicatedDeviceMemory(vk::DeviceSize size, uint32_t typeIndex, vk::Image image, MemoryTypeSelector *memoryTypeSelector = nullptr) const;
+      auto getDedicatedMemoryRequirements(vk::Buffer buffer) const;
+      auto getDedicatedMemoryRequirements(vk::Image image) const;
       auto selectAndCreateDeviceMemory(vk::PhysicalDevice physicalDevice,
                                        vk::DeviceSize size,
                                        vk::MemoryPropertyFlags memoryFlags,
                                        uint32_t memoryTypeIndexMask) const;
+      auto selectAndCreateDeviceMemory(MemoryTypeSelector &memoryTypeSelector,
+                                       vk::DeviceSize size,
+                                       vk::MemoryPropertyFlags requiredFlags,
+                                       vk::MemoryPropertyFlags preferredFlags,
+                                       uint32_t memoryTypeIndexMask) const;
 
       auto createDescriptorSetLayout(std::vector<vk::DescriptorSetLayoutBinding> const &bindings) const;
       auto createDescriptorPool(std::uint32_t maxSets, std::vector<vk::DescriptorPoolSize> const &size) const;
@@ -1,26 +1,115 @@
 #pragma once
 
 #include "magma/Device.hpp"
+#include "magma/MemoryTypeSelector.hpp"
 
 namespace magma
 {
   struct DeviceMemoryDeleter
   {
     Device<claws::no_delete> device;
+    MemoryTypeSelector *memoryTypeSelector{nullptr};
+    uint32_t typeIndex{0u};
+    vk::DeviceSize size{0u};
 
     void operator()(vk::DeviceMemory const &fence) const
     {
       if (device)
-        device.freeMemory(fence);
+        {
+          device.freeMemory(fence);
+          if (memoryTypeSelector && fence)
+            memoryTypeSelector->notifyFree(typeIndex, size);
+        }
     }
   };
 
   template<class Deleter = DeviceMemoryDeleter>
   using DeviceMemory = claws::handle<vk::DeviceMemory, Deleter>;
 
-  inline auto impl::Device::createDeviceMemory(vk::DeviceSize size, uint32_t typeIndex) const
+  ///
+  /// \brief Allocates `size` bytes of memory of type `typeIndex`
+  ///
+  /// If `memoryTypeSelector` is given, the allocation is accounted in its heap usage until it is freed, so it must outlive the allocation.
+  ///
+  inline auto impl::Device::createDeviceMemory(vk::DeviceSize size, uint32_t typeIndex, MemoryTypeSelector *memoryTypeSelector) const
   {
-    return DeviceMemory<>(DeviceMemoryDeleter{magma::Device<claws::no_delete>(*this)}, vk::Device::allocateMemory({size, typeIndex}));
+    DeviceMemory<> deviceMemory(DeviceMemoryDeleter{magma::Device<claws::no_delete>(*this), memoryTypeSelector, typeIndex, size},
+                                vk::Device::allocateMemory({size, typeIndex}));
+
+    if (memoryTypeSelector)
+      memoryTypeSelector->notifyAllocation(typeIndex, size);
+    return deviceMemory;
+  }
+
+  ///
+  /// \brief Allocates memory dedicated to `buffer`, as `VK_KHR_dedicated_allocation` allows
+  ///
+  /// Requires Vulkan 1.1, or `VK_KHR_dedicated_allocation` to be enabled.
+  /// `memoryTypeSelector` accounts for the allocation as with `createDeviceMemory`.
+  ///
+  inline auto impl::Device::createDedicatedDeviceMemory(vk::DeviceSize size, uint32_t typeIndex, vk::Buffer buffer, MemoryTypeSelector *memoryTypeSelector) const
+  {
+    vk::MemoryDedicatedAllocateInfo dedicatedInfo{nullptr, buffer};
+    vk::MemoryAllocateInfo allocateInfo{size, typeIndex};
+
+    allocateInfo.pNext = &dedicatedInfo;
+
+    DeviceMemory<> deviceMemory(DeviceMemoryDeleter{magma::Device<claws::no_delete>(*this), memoryTypeSelector, typeIndex, size},
+                                vk::Device::allocateMemory(allocateInfo));
+
+    if (memoryTypeSelector)
+      memoryTypeSelector->notifyAllocation(typeIndex, size);
+    return deviceMemory;
+  }
+
+  ///
+  /// \brief Allocates memory dedicated to `image`, as `VK_KHR_dedicated_allocation` allows
+  ///
+  /// Requires Vulkan 1.1, or `VK_KHR_dedicated_allocation` to be enabled.
+  /// `memoryTypeSelector` accounts for the allocation as with `createDeviceMemory`.
+  ///
+  inline auto impl::Device::createDedicatedDeviceMemory(vk::DeviceSize size, uint32_t typeIndex, vk::Image image, MemoryTypeSelector *memoryTypeSelector) const
+  {
+    vk::MemoryDedicatedAllocateInfo dedicatedInfo{image, nullptr};
+    vk::MemoryAllocateInfo allocateInfo{size, typeIndex};
+
+    allocateInfo.pNext = &dedicatedInfo;
+
+    DeviceMemory<> deviceMemory(DeviceMemoryDeleter{magma::Device<claws::no_delete>(*this), memoryTypeSelector, typeIndex, size},
+                                vk::Device::allocateMemory(allocateInfo));
+
+    if (memoryTypeSelector)
+      memoryTypeSelector->notifyAllocation(typeIndex, size);
+    return deviceMemory;
+  }
+
+  struct DedicatedMemoryRequirements
+  {
+    vk::MemoryRequirements memoryRequirements;
+    bool prefersDedicatedAllocation;
+    bool requiresDedicatedAllocation;
+  };
+
+  /// \brief Queries `buffer`'s memory requirements along with the driver's opinion on dedicated allocations, requires Vulkan 1.1
+  inline auto impl::Device::getDedicatedMemoryRequirements(vk::Buffer buffer) const
+  {
+    auto const requirements(vk::Device::getBufferMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>({buffer}));
+    auto const &dedicated(requirements.get<vk::MemoryDedicatedRequirements>());
+
+    return DedicatedMemoryRequirements{requirements.get<vk::MemoryRequirements2>().memoryRequirements,
+                                       bool(dedicated.prefersDedicatedAllocation),
+                                       bool(dedicated.requiresDedicatedAllocation)};
+  }
+
+  /// \brief Queries `image`'s memory requirements along with the driver's opinion on dedicated allocations, requires Vulkan 1.1
+  inline auto impl::Device::getDedicatedMemoryRequirements(vk::Image image) const
+  {
+    auto const requirements(vk::Device::getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>({image}));
+    auto const &dedicated(requirements.get<vk::MemoryDedicatedRequirements>());
+
+    return DedicatedMemoryRequirements{requirements.get<vk::MemoryRequirements2>().memoryRequirements,
+                                       bool(dedicated.prefersDedicatedAllocation),
+                                       bool(dedicated.requiresDedicatedAllocation)};
   }
 
   inline auto selectDeviceMemoryType(vk::PhysicalDevice physicalDevice,
@@ -40,6 +129,24 @@ namespace magma
     throw std::runtime_error("Couldn't find proper memory type");
   }
 
+  ///
+  /// \brief Selects the memory type `memoryTypeSelector` ranks best for an allocation of `size` bytes
+  ///
+  /// Unlike `MemoryTypeSelector::select`, throws when no type has the required flags and room left in its heap's budget.
+  ///
+  inline auto selectDeviceMemoryType(MemoryTypeSelector const &memoryTypeSelector,
+                                     vk::DeviceSize size,
+                                     vk::MemoryPropertyFlags requiredFlags,
+                                     vk::MemoryPropertyFlags preferredFlags,
+                                     uint32_t memoryTypeIndexMask)
+  {
+    auto const typeIndex(memoryTypeSelector.select(size, requiredFlags, preferredFlags, memoryTypeIndexMask));
+
+    if (!typeIndex)
+      throw std::runtime_error("Couldn't find proper memory type within budget");
+    return *typeIndex;
+  }
+
   inline auto impl::Device::selectAndCreateDeviceMemory(vk::PhysicalDevice physicalDevice,
                                                         vk::DeviceSize size,
                                                         vk::MemoryPropertyFlags memoryFlags,
@@ -47,4 +154,32 @@ namespace magma
   {
     return createDeviceMemory(size, selectDeviceMemoryType(physicalDevice, size, memoryFlags, memoryTypeIndexMask));
   }
+
+  ///
+  /// \brief Allocates memory of the type `memoryTypeSelector` ranks best, falling back to the next best types if the driver runs out of memory
+  ///
+  /// The allocation is accounted in `memoryTypeSelector`'s heap usage until it is freed, so `memoryTypeSelector` must outlive it.
+  ///
+  inline auto impl::Device::selectAndCreateDeviceMemory(MemoryTypeSelector &memoryTypeSelector,
+                                                        vk::DeviceSize size,
+                                                        vk::MemoryPropertyFlags requiredFlags,
+                                                        vk::MemoryPropertyFlags preferredFlags,
+                                                        uint32_t memoryTypeIndexMask) const
+  {
+    while (true)
+      {
+        auto const typeIndex(memoryTypeSelector.select(size, requiredFlags, preferredFlags, memoryTypeIndexMask));
+
+        if (!typeIndex)
+          throw std::runtime_error("Couldn't find proper memory type within budget");
+        try
+          {
+            return createDeviceMemory(size, *typeIndex, &memoryTypeSelector);
+          }
+        catch (vk::OutOfDeviceMemoryError const &)
+          {
+            memoryTypeIndexMask &= ~(1u << *typeIndex);
+          }
+      }
+  }
 };
@@ -12,6 +12,7 @@
 #include "magma/Semaphore.hpp"
 #include "magma/ImageView.hpp"
 #include "magma/CreateInfo.hpp"
+#include "magma/DeletionQueue.hpp"
 
 namespace magma {
   ///
@@ -58,6 +59,7 @@ namespace magma {
     SwapchainUserData swapchainUserData;
   private:
     std::vector<FrameData> frames;
+    DeletionQueue *deletionQueue{nullptr};
 
     template<class T, class = void>
     struct CallExtentOrReturnDefault
@@ -98,10 +100,31 @@ namespace magma {
       recreateSwapchain();
     }
 
+    ///
+    /// \brief Retires the resources of replaced swapchains to `deletionQueue`, instead of waiting for the device to be idle
+    ///
+    /// The caller closes the queue's buckets with `endFrame` and collects them as usual.
+    /// `nullptr` restores the `waitIdle` behaviour.
+    ///
+    void setDeletionQueue(DeletionQueue *deletionQueue) noexcept
+    {
+      this->deletionQueue = deletionQueue;
+    }
+
     void recreateSwapchain()
     {
-      swapchain = magma::Swapchain<>(surface, device, physicalDevice, swapchain, CallExtentOrReturnDefault<UserData>{}(userData));
-      device.waitIdle();
+      magma::Swapchain<> newSwapchain(surface, device, physicalDevice, swapchain, CallExtentOrReturnDefault<UserData>{}(userData));
+
+      if (deletionQueue)
+	{
+	  deletionQueue->retire(std::move(frames));
+	  deletionQueue->retire(std::move(swapchainUserData));
+	  deletionQueue->retire(std::move(swapchain));
+	  frames = {};
+	}
+      swapchain = std::move(newSwapchain);
+      if (!deletionQueue)
+	device.waitIdle();
       auto const &swapchainImages(swapchain.getImages());
       swapchainUserData = SwapchainUserData(device, swapchain, userData, static_cast<uint32_t>(swapchainImages.size()));
 
@@ -1,106 +1,105 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
+#include <map>
 #include <cassert>
 #include <optional>
 
+#include "magma/Buffer.hpp"
+#include "magma/CommandBuffer.hpp"
+#include "magma/DeviceMemory.hpp"
+#include "magma/Fence.hpp"
+#include "magma/TlsfAllocator.hpp"
+
 namespace magma
 {
   class DynamicBuffer
   {
   public:
-    using RangeId = std::pair<uint32_t, uint32_t>;
+    /// the index of a chunk, and the offset of the range in the chunk's buffer
+    using RangeId = std::pair<uint32_t, vk::DeviceSize>;
+
+    static constexpr RangeId nullId{0u, ~vk::DeviceSize(0u)};
 
-    static constexpr RangeId nullId{0u, ~0u};
+    /// an old range, and the range its content is moved to
+    using Relocation = std::pair<RangeId, RangeId>;
+
+    enum class MappingMode
+    {
+      onAccess,  ///< `getMemory` maps and unmaps the range every time
+      persistent ///< host-visible chunks are mapped once, when they are created
+    };
 
   private:
     struct Range
     {
-      uint32_t begin;
-      uint32_t end;
+      vk::DeviceSize begin;
+      vk::DeviceSize end;
     };
 
     struct Chunk
     {
-      struct Err
-      {};
       DeviceMemory<> deviceMemory;
       Buffer<> buffer;
-      uint32_t size;
-      std::vector<Range> ranges;
+      vk::DeviceSize size;
+      TlsfAllocator<vk::DeviceSize> allocator;
+      vk::DeviceSize memorySize;
+      bool isCoherent;
+      bool isDedicated;
+      bool isEvacuated;
+      void *mapping;
 
-      auto findRange(uint32_t index) const
+      std::optional<vk::DeviceSize> allocate(vk::DeviceSize allocSize, vk::DeviceSize alignment)
       {
-        return std::lower_bound(ranges.begin(), ranges.end(), index, [](auto const &range, auto index) { return range.begin < index; });
+        return allocator.allocate(allocSize, alignment);
       }
 
-      auto findRange(uint32_t index)
+      vk::DeviceSize removeRange(vk::DeviceSize index)
       {
-        return std::lower_bound(ranges.begin(), ranges.end(), index, [](auto const &range, auto index) { return range.begin < index; });
+        vk::DeviceSize removeSize(allocator.deallocate(index));
+
+        if (!allocator.getAllocationCount())
+          *this = Chunk{};
+        return removeSize;
       }
 
-      uint32_t allocate(uint32_t allocSize)
+      bool resizeRange(vk::DeviceSize index, vk::DeviceSize newSize)
       {
-        if (ranges.empty())
-          {
-            if (allocSize <= size)
-              {
-                ranges.push_back({0, allocSize});
-                return (ranges.back().begin);
-              }
-          }
-        else
-          {
-            if (allocSize < ranges[0].begin)
-              return ranges.insert(ranges.begin(), {0, allocSize})->begin;
-            auto it(ranges.begin());
-            auto prev(it);
-
-            ++it;
-            for (; it != ranges.end(); prev = it++)
-              {
-                if (prev->end + allocSize <= it->begin)
-                  return ranges.insert(it, {prev->end, prev->end + allocSize})->begin;
-                prev = it;
-              }
-            if (prev->end + allocSize < size)
-              {
-                ranges.push_back({prev->end, prev->end + allocSize});
-                return (ranges.back().begin);
-              }
-          }
-        throw Err{};
+        return allocator.resize(index, newSize);
       }
 
-      uint32_t removeRange(uint32_t index)
+      Range getRange(vk::DeviceSize index) const
       {
-        if (ranges.size() > 1)
-          {
-            auto rangeIt = findRange(index);
-            uint32_t removeSize(rangeIt->end - rangeIt->begin);
-
-            ranges.erase(rangeIt);
-            return removeSize;
-          }
-        uint32_t removeSize(ranges.back().end - ranges.back().begin);
-
-        *this = Chunk{};
-        return removeSize;
+        return {index, index + allocator.getSize(index)};
       }
 
-      void resizeRange(uint32_t index, uint32_t newSize)
+      /// \brief Grows `range` to `atomSize` boundaries, as required to map and flush non-coherent memory
+      std::pair<vk::DeviceSize, vk::DeviceSize> getAlignedRange(Range range, vk::DeviceSize atomSize) const
       {
-        auto rangeIt(findRange(index));
-
-        rangeIt->end = rangeIt->begin + newSize;
+        return {range.begin & ~(atomSize - 1), std::min((range.end + atomSize - 1) & ~(atomSize - 1), memorySize)};
       }
+    };
 
-      Range const &getRange(uint32_t index) const
-      {
-        auto rangeIt(findRange(index));
+    struct MappedRangeDeleter
+    {
+      Device<claws::no_delete> device;
+      DeviceMemory<claws::no_delete> deviceMemory;
+      vk::DeviceSize offset;
+      vk::DeviceSize size;
+      bool needsFlush;
+      bool needsUnmap;
 
-        assert(rangeIt != ranges.end() && rangeIt->begin == index);
-        return *rangeIt;
+      template<class T>
+      void operator()(T *data) const
+      {
+        if (data)
+          {
+            if (needsFlush)
+              device.flushMappedMemoryRanges({vk::MappedMemoryRange{deviceMemory, offset, size}});
+            if (needsUnmap)
+              device.unmapMemory(deviceMemory);
+          }
       }
     };
 
@@ -110,27 +109,101 @@ namespace magma
     vk::BufferUsageFlags usage;
     vk::MemoryPropertyFlags memoryFlags;
     std::optional<std::vector<uint32_t>> queueFamilies;
-    uint32_t allocatedSize;
+    MappingMode mappingMode;
+    vk::DeviceSize nonCoherentAtomSize;
+    uint32_t offsetAlignment;
+    std::optional<vk::DeviceSize> dedicatedThreshold;
+    MemoryTypeSelector *memoryTypeSelector{nullptr};
+    vk::DeviceSize allocatedSize;
     uint32_t bestChunk;
 
     std::vector<Chunk> chunks;
 
+    std::optional<uint32_t> evacuatedChunk;
+    std::vector<vk::DeviceSize> evacuationQueue;
+    std::vector<std::pair<Fence<claws::no_delete>, std::vector<RangeId>>> pendingMoves;
+
+    bool canHoldMoves(Chunk const &chunk) const noexcept
+    {
+      return chunk.size && !chunk.isDedicated && !chunk.isEvacuated;
+    }
+
+    /// picks the least used chunk whose content fits in the free space of the others
+    std::optional<uint32_t> pickSparsestChunk() const
+    {
+      vk::DeviceSize freeSize(0u);
+
+      for (auto const &chunk : chunks)
+        if (canHoldMoves(chunk))
+          freeSize += chunk.size - chunk.allocator.getAllocatedSize();
+
+      std::optional<uint32_t> sparsest;
+      double lowestUsage(1.0);
+
+      for (uint32_t i(0u); i < chunks.size(); ++i)
+        {
+          Chunk const &chunk(chunks[i]);
+
+          if (!canHoldMoves(chunk) || !chunk.allocator.getAllocationCount())
+            continue;
+
+          vk::DeviceSize const usedSize(chunk.allocator.getAllocatedSize());
+          double const usage(double(usedSize) / double(chunk.size));
+
+          if (usage < lowestUsage && usedSize <= freeSize - (chunk.size - usedSize))
+            {
+              sparsest = i;
+              lowestUsage = usage;
+            }
+        }
+      return sparsest;
+    }
+
+    std::optional<RangeId> allocateForMove(vk::DeviceSize size, vk::DeviceSize alignment)
+    {
+      for (uint32_t i(0u); i < chunks.size(); ++i)
+        if (canHoldMoves(chunks[i]))
+          if (auto offset = chunks[i].allocate(size, alignment))
+            {
+              allocatedSize += size;
+              return RangeId{i, *offset};
+            }
+      return std::nullopt;
+    }
+
+    void stopEvacuation()
+    {
+      if (evacuatedChunk && *evacuatedChunk < chunks.size())
+        chunks[*evacuatedChunk].isEvacuated = false;
+      evacuatedChunk.reset();
+      evacuationQueue.clear();
+    }
+
   public:
     DynamicBuffer(Device<claws::no_delete> device,
                   vk::PhysicalDevice physicalDevice,
                   vk::BufferCreateFlags createFlags,
                   vk::BufferUsageFlags usage,
                   vk::MemoryPropertyFlags memoryFlags,
-                  std::optional<std::vector<uint32_t>> &&queueFamilies = {})
+                  std::optional<std::vector<uint32_t>> &&queueFamilies = {},
+                  MappingMode mappingMode = MappingMode::onAccess)
       : device(device)
       , physicalDevice(physicalDevice)
       , createFlags(createFlags)
       , usage(usage)
       , memoryFlags(memoryFlags)
       , queueFamilies(queueFamilies)
+      , mappingMode(mappingMode)
+      , dedicatedThreshold()
+      , memoryTypeSelector(nullptr)
       , allocatedSize(0u)
       , chunks()
-    {}
+    {
+      auto const limits(physicalDevice.getProperties().limits);
+
+      nonCoherentAtomSize = limits.nonCoherentAtomSize;
+      offsetAlignment = getMinOffsetAlignment(limits, usage);
+    }
 
     DynamicBuffer() = default;
     DynamicBuffer(DynamicBuffer const &) = delete;
@@ -148,35 +221,115 @@ namespace magma
       return static_cast<uint32_t>(chunks.size() - 1);
     }
 
-    void initChunk(Chunk &newChunk, uint32_t size)
+    ///
+    /// \brief Lets ranges of at least `threshold` bytes, and chunks the driver wants dedicated memory for, get a dedicated allocation
+    ///
+    /// A dedicated range gets a chunk of its own, which no other range will share, and which is released along with the range.
+    /// The driver is asked about each chunk through `getBufferMemoryRequirements2`, so this requires Vulkan 1.1 or `VK_KHR_dedicated_allocation`.
+    ///
+    void enableDedicatedAllocations(vk::DeviceSize threshold = ~vk::DeviceSize(0u))
+    {
+      dedicatedThreshold = threshold;
+    }
+
+    ///
+    /// \brief Picks the memory type of new chunks with `memoryTypeSelector`, which accounts for them in its heap usage
+    ///
+    /// `memoryFlags` become required flags, and types whose heap is over budget are skipped.
+    /// `memoryTypeSelector` must outlive the chunks, passing `nullptr` goes back to the first type with any of `memoryFlags`.
+    ///
+    void setMemoryTypeSelector(MemoryTypeSelector *memoryTypeSelector) noexcept
+    {
+      this->memoryTypeSelector = memoryTypeSelector;
+    }
+
+    void initChunk(Chunk &newChunk, vk::DeviceSize size, bool isDedicated = false)
     {
       newChunk.size = size;
+      newChunk.isDedicated = isDedicated;
+      newChunk.isEvacuated = false;
+      newChunk.allocator = TlsfAllocator<vk::DeviceSize>(size);
       if (queueFamilies)
         newChunk.buffer = device.createBuffer(createFlags, newChunk.size, usage, *queueFamilies);
       else
         newChunk.buffer = device.createBuffer(createFlags, newChunk.size, usage);
-      auto memRequirements(device.getBufferMemoryRequirements(newChunk.buffer));
 
-      newChunk.deviceMemory = device.selectAndCreateDeviceMemory(physicalDevice, memRequirements.size, memoryFlags, memRequirements.memoryTypeBits);
+      vk::MemoryRequirements memRequirements;
+      bool dedicatedMemory(isDedicated);
+
+      if (dedicatedThreshold)
+        {
+          auto const requirements(device.getDedicatedMemoryRequirements(newChunk.buffer));
+
+          memRequirements = requirements.memoryRequirements;
+          dedicatedMemory = dedicatedMemory || requirements.prefersDedicatedAllocation || requirements.requiresDedicatedAllocation;
+        }
+      else
+        memRequirements = device.getBufferMemoryRequirements(newChunk.buffer);
+      auto const typeIndex(memoryTypeSelector
+                             ? selectDeviceMemoryType(*memoryTypeSelector, memRequirements.size, memoryFlags, {}, memRequirements.memoryTypeBits)
+                             : selectDeviceMemoryType(physicalDevice, memRequirements.size, memoryFlags, memRequirements.memoryTypeBits));
+      auto const typeFlags(memoryTypeSelector ? memoryTypeSelector->getMemoryProperties().memoryTypes[typeIndex].propertyFlags
+                                              : physicalDevice.getMemoryProperties().memoryTypes[typeIndex].propertyFlags);
+
+      if (dedicatedMemory)
+        newChunk.deviceMemory = device.createDedicatedDeviceMemory(memRequirements.size, typeIndex, newChunk.buffer, memoryTypeSelector);
+      else
+        newChunk.deviceMemory = device.createDeviceMemory(memRequirements.size, typeIndex, memoryTypeSelector);
+      newChunk.memorySize = memRequirements.size;
+      newChunk.isCoherent = bool(typeFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
       device.bindBufferMemory(newChunk.buffer, newChunk.deviceMemory, 0);
+      if (mappingMode == MappingMode::persistent && (typeFlags & vk::MemoryPropertyFlagBits::eHostVisible))
+        newChunk.mapping = device.mapMemory(newChunk.deviceMemory, 0, VK_WHOLE_SIZE);
+      else
+        newChunk.mapping = nullptr;
     }
 
-    RangeId allocate(uint32_t size)
+    /// \brief Returns the offset alignment the buffer usage requires for descriptors and dynamic offsets, see `magma::getMinOffsetAlignment`
+    uint32_t getOffsetAlignment() const noexcept
     {
-      allocatedSize += size;
-      try
+      return offsetAlignment;
+    }
+
+    RangeId allocate(vk::DeviceSize size)
+    {
+      return allocate(size, 1u);
+    }
+
+    ///
+    /// \brief Allocates a range whose offset in its buffer is a multiple of `alignment`
+    ///
+    /// `alignment` must be a power of two, such as the value returned by `getOffsetAlignment`.
+    /// Every chunk's buffer is bound at the start of its own memory, so the buffer's memory requirement alignment doesn't apply to ranges.
+    /// Ranges past the dedicated allocation threshold get a chunk of their own, and aren't counted when sizing shared chunks.
+    ///
+    RangeId allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+    {
+      if (dedicatedThreshold && size >= *dedicatedThreshold)
         {
-          for (uint32_t i(0u); i < chunks.size(); ++i)
+          auto index(getAvailableChunk());
+
+          try
             {
-              try
-                {
-                  return {i, chunks[i].allocate(size)};
-                }
-              catch (Chunk::Err const &)
-                {
-                }
+              initChunk(chunks[index], size, true);
             }
-
+          catch (...)
+            {
+              chunks[index] = Chunk{};
+              throw;
+            }
+          return {index, *chunks[index].allocate(size, alignment)};
+        }
+      for (uint32_t i(0u); i < chunks.size(); ++i)
+        if (!chunks[i].isDedicated && !chunks[i].isEvacuated)
+          if (auto offset = chunks[i].allocate(size, alignment))
+            {
+              allocatedSize += size;
+              return {i, *offset};
+            }
+      allocatedSize += size;
+      try
+        {
           auto index(getAvailableChunk());
           Chunk &newChunk(chunks[index]);
 
@@ -189,7 +342,7 @@ namespace magma
             {
               initChunk(newChunk, size);
             }
-          return {index, newChunk.allocate(size)};
+          return {index, *newChunk.allocate(size, alignment)};
         }
       catch (...)
         {
@@ -202,44 +355,151 @@ namespace magma
     {
       if (index == nullId)
         return;
-      if (index.first == chunks.size() - 1 && chunks.back().ranges.size() <= 1)
+
+      bool const isDedicated(chunks[index.first].isDedicated);
+      vk::DeviceSize removedSize;
+
+      if (index.first == chunks.size() - 1 && chunks.back().allocator.getAllocationCount() <= 1)
         {
-          allocatedSize -= chunks.back().ranges.front().end - chunks.back().ranges.front().begin;
+          removedSize = chunks.back().allocator.getSize(index.second);
           chunks.resize(chunks.size() - 1);
         }
       else
-        allocatedSize -= chunks[index.first].removeRange(index.second);
+        removedSize = chunks[index.first].removeRange(index.second);
+      if (!isDedicated)
+        allocatedSize -= removedSize;
     }
 
+    ///
+    /// \brief Gives host access to a range, as a `std::unique_ptr`
+    ///
+    /// Persistently mapped chunks just hand out a pointer into their mapping, other chunks are mapped on the fly.
+    /// When the pointer is released, the range is flushed unless its memory is host coherent, and unmapped if it was mapped on the fly.
+    ///
     template<class PtrType>
     auto getMemory(RangeId index)
     {
-      Range const &range(chunks[index.first].getRange(index.second));
-      auto deleter([ device = this->device, deviceMemory = DeviceMemory<claws::no_delete>(chunks[index.first].deviceMemory), range = range](auto data) {
-        if (data)
-	  {
-	    vk::MappedMemoryRange flushRange {
-	      deviceMemory,
-		range.begin,
-		range.end - range.begin
-	    };
-	    device.flushMappedMemoryRanges( {flushRange} );
-	    device.unmapMemory(deviceMemory);
-	  }
-      });
-      return std::unique_ptr<PtrType, decltype(deleter)>(reinterpret_cast<std::decay_t<PtrType>>(
-                                                           device.mapMemory(chunks[index.first].deviceMemory, range.begin, range.end - range.begin)),
-                                                         deleter);
+      Chunk const &chunk(chunks[index.first]);
+      Range const range(chunk.getRange(index.second));
+      auto const [begin, end] = chunk.getAlignedRange(range, nonCoherentAtomSize);
+      MappedRangeDeleter deleter{device, chunk.deviceMemory, begin, end - begin, !chunk.isCoherent, !chunk.mapping};
+      char *data(chunk.mapping ? static_cast<char *>(chunk.mapping) + range.begin
+                               : static_cast<char *>(device.mapMemory(chunk.deviceMemory, begin, end - begin)) + (range.begin - begin));
+
+      return std::unique_ptr<PtrType, MappedRangeDeleter>(reinterpret_cast<std::decay_t<PtrType>>(data), deleter);
     }
 
-    void resize(RangeId index, uint32_t size)
+    /// \brief Resizes a range in place, returns `false` if it couldn't grow without moving
+    bool resize(RangeId index, vk::DeviceSize size)
     {
-      chunks[index.first].resizeRange(index.second, size);
+      vk::DeviceSize const oldSize(chunks[index.first].getRange(index.second).end - index.second);
+
+      if (!chunks[index.first].resizeRange(index.second, size))
+        return false;
+      if (!chunks[index.first].isDedicated)
+        {
+          allocatedSize += size;
+          allocatedSize -= oldSize;
+        }
+      return true;
+    }
+
+    ///
+    /// \brief Moves ranges out of sparse chunks, so that they can be released
+    ///
+    /// Records `copyBuffer` commands on `commandBuffer`, moving at most `byteBudget` bytes (or a single range, if it is bigger than that).
+    /// The sparsest chunk stops receiving new ranges until it is emptied, and is evacuated over as many calls as the budget requires.
+    /// Moved ranges keep the alignment of their offset, up to 256 bytes, which covers every offset alignment Vulkan limits can require.
+    /// The caller is responsible for the barriers around the copies, and for submitting `commandBuffer` with `fence`.
+    /// The old ranges stay allocated until `releaseMoves` sees `fence` signaled, at which point emptied chunks are released.
+    /// @return the relocations that were recorded: every old `RangeId` must be replaced by its new one, and never freed.
+    ///
+    std::vector<Relocation> defragment(CommandBuffer const &commandBuffer, Fence<claws::no_delete> fence, vk::DeviceSize byteBudget)
+    {
+      std::vector<Relocation> relocations;
+      std::vector<RangeId> movedRanges;
+      std::map<std::pair<uint32_t, uint32_t>, std::vector<vk::BufferCopy>> copies;
+
+      while (byteBudget)
+        {
+          if (evacuatedChunk && (*evacuatedChunk >= chunks.size() || !chunks[*evacuatedChunk].isEvacuated))
+            stopEvacuation();
+          if (!evacuatedChunk)
+            {
+              if (!(evacuatedChunk = pickSparsestChunk()))
+                break;
+              chunks[*evacuatedChunk].isEvacuated = true;
+              chunks[*evacuatedChunk].allocator.forEachAllocation([this](vk::DeviceSize offset, vk::DeviceSize) { evacuationQueue.push_back(offset); });
+            }
+          if (evacuationQueue.empty())
+            {
+              evacuatedChunk.reset();
+              continue;
+            }
+
+          uint32_t const sourceIndex(*evacuatedChunk);
+          vk::DeviceSize const offset(evacuationQueue.back());
+          Chunk const &source(chunks[sourceIndex]);
+
+          if (!source.allocator.isAllocated(offset))
+            {
+              evacuationQueue.pop_back();
+              continue;
+            }
+
+          vk::DeviceSize const size(source.allocator.getSize(offset));
+
+          if (size > byteBudget && !relocations.empty())
+            break;
+
+          vk::DeviceSize const alignment(offset ? std::min(offset & ~(offset - 1u), vk::DeviceSize(256u)) : 256u);
+          auto const destination(allocateForMove(size, alignment));
+
+          if (!destination)
+            {
+              stopEvacuation();
+              break;
+            }
+          evacuationQueue.pop_back();
+          copies[{sourceIndex, destination->first}].push_back({offset, destination->second, size});
+          relocations.push_back({{sourceIndex, offset}, *destination});
+          movedRanges.push_back({sourceIndex, offset});
+          byteBudget -= std::min(size, byteBudget);
+        }
+      for (auto const &[chunkPair, regions] : copies)
+        commandBuffer.copyBuffer(chunks[chunkPair.first].buffer, chunks[chunkPair.second].buffer, regions);
+      if (!movedRanges.empty())
+        pendingMoves.emplace_back(fence, std::move(movedRanges));
+      return relocations;
+    }
+
+    ///
+    /// \brief Frees the old ranges of every `defragment` call whose fence is signaled
+    ///
+    /// Must be called before those fences are reset, typically right after waiting on them.
+    ///
+    void releaseMoves()
+    {
+      for (auto it(pendingMoves.begin()); it != pendingMoves.end();)
+        if (device.getFenceStatus(it->first) == vk::Result::eSuccess)
+          {
+            for (auto const &range : it->second)
+              free(range);
+            it = pendingMoves.erase(it);
+          }
+        else
+          ++it;
     }
 
     magma::Buffer<claws::no_delete> getBuffer(RangeId index)
     {
       return chunks[index.first].buffer;
     }
+
+    /// \brief Returns the size of a range, which can be a little more than it was allocated with
+    vk::DeviceSize getSize(RangeId index) const
+    {
+      return chunks[index.first].allocator.getSize(index.second);
+    }
   };
 };
@@ -0,0 +1,668 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include "magma/BarrierBatcher.hpp"
+#include "magma/CommandBuffer.hpp"
+#include "magma/DeletionQueue.hpp"
+#include "magma/DeviceMemory.hpp"
+#include "magma/Framebuffer.hpp"
+#include "magma/Image.hpp"
+#include "magma/ImageView.hpp"
+#include "magma/RenderPass.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Orders the passes of a frame, and derives their synchronization and transient resources from what they read and write
+  ///
+  /// Passes are added in execution order, and declare the images and buffers they use.
+  /// `compile` then:
+  ///  - culls the passes that contribute to no imported resource or resource marked with `markOutput`,
+  ///  - creates the transient images, placing images whose lifetimes don't overlap in the same memory,
+  ///  - creates a render pass for every render pass, storing attachments only when a later pass reads them.
+  /// `execute` records the passes, with the barriers and layout transitions their uses require between them, batched per pass.
+  ///
+  /// Imported resources are synchronized with the rest of the frame by the caller, e.g. with semaphores,
+  /// and imported images are transitioned to their final layout at the end of `execute`.
+  ///
+  class FrameGraph
+  {
+  public:
+    using ResourceId = uint32_t;
+    using PassId = uint32_t;
+
+    struct ImageDesc
+    {
+      vk::Format format;
+      vk::Extent2D extent;
+      vk::SampleCountFlagBits samples{vk::SampleCountFlagBits::e1};
+      vk::ImageAspectFlags aspect{vk::ImageAspectFlagBits::eColor};
+      /// usage the graph can't infer, e.g. `eTransferSrc` for images read by copies
+      vk::ImageUsageFlags extraUsage{};
+    };
+
+  private:
+    struct Use
+    {
+      ResourceId resource;
+      vk::PipelineStageFlags stages;
+      vk::AccessFlags access;
+      vk::ImageLayout layout;
+      bool isWrite;
+      bool readsPrevious;
+    };
+
+    struct Attachment
+    {
+      ResourceId resource;
+      vk::AttachmentLoadOp loadOp;
+      vk::ClearValue clearValue;
+    };
+
+    struct Pass
+    {
+      std::function<void(PrimaryCommandBuffer const &, RenderPassExecLock const &)> recordRenderPass;
+      std::function<void(PrimaryCommandBuffer const &)> record;
+      std::vector<Use> uses;
+      std::vector<Attachment> colorAttachments;
+      std::optional<Attachment> depthAttachment;
+      bool isAlive;
+      RenderPass<> renderPass;
+      std::map<std::vector<vk::ImageView>, Framebuffer<>> framebuffers;
+    };
+
+    struct Resource
+    {
+      bool isImage;
+      bool isImported;
+      bool isOutput;
+      ImageDesc desc;
+      vk::ImageLayout initialLayout;
+      vk::ImageLayout finalLayout;
+      vk::Image image;
+      vk::ImageView view;
+      vk::Buffer buffer;
+      std::optional<uint32_t> memorySlot;
+      Image<> ownedImage;
+      ImageView<> ownedView;
+    };
+
+    struct ResourceState
+    {
+      vk::ImageLayout layout;
+      vk::PipelineStageFlags writeStages;
+      vk::AccessFlags writeAccess;
+      vk::PipelineStageFlags readStages;
+    };
+
+    struct MemorySlot
+    {
+      DeviceMemory<> deviceMemory;
+      vk::DeviceSize size;
+      uint32_t memoryTypeBits;
+      std::vector<std::pair<uint32_t, uint32_t>> lifetimes;
+      std::optional<ResourceId> lastResource;
+      vk::PipelineStageFlags lastStages;
+      vk::AccessFlags lastAccess;
+    };
+
+    /// what a compilation creates, declared so that users are destroyed before what they use
+    struct Compiled
+    {
+      std::vector<MemorySlot> memorySlots;
+      std::vector<Image<>> images;
+      std::vector<ImageView<>> views;
+      std::vector<RenderPass<>> renderPasses;
+      std::vector<Framebuffer<>> framebuffers;
+    };
+
+    Device<claws::no_delete> device;
+    vk::PhysicalDevice physicalDevice;
+    std::vector<MemorySlot> memorySlots;
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    DeletionQueue *deletionQueue{nullptr};
+
+    /// destroys `objects` once frames in flight are done with them
+    template<class T>
+    void retire(T &&objects)
+    {
+      if (deletionQueue)
+        deletionQueue->retire(std::move(objects));
+      else
+        {
+          device.waitIdle();
+
+          T const stale(std::move(objects));
+        }
+    }
+
+    ResourceId addResource(Resource &&resource)
+    {
+      resources.push_back(std::move(resource));
+      return static_cast<ResourceId>(resources.size() - 1);
+    }
+
+    static bool isReadAccess(vk::AccessFlags access) noexcept
+    {
+      return bool(access
+                  & (vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eVertexAttributeRead
+                     | vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eInputAttachmentRead | vk::AccessFlagBits::eShaderRead
+                     | vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentRead
+                     | vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eHostRead | vk::AccessFlagBits::eMemoryRead));
+    }
+
+    static vk::ImageUsageFlags getImageUsage(vk::ImageLayout layout) noexcept
+    {
+      switch (layout)
+        {
+        case vk::ImageLayout::eColorAttachmentOptimal:
+          return vk::ImageUsageFlagBits::eColorAttachment;
+        case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+          return vk::ImageUsageFlagBits::eDepthStencilAttachment;
+        case vk::ImageLayout::eShaderReadOnlyOptimal:
+          return vk::ImageUsageFlagBits::eSampled;
+        case vk::ImageLayout::eGeneral:
+          return vk::ImageUsageFlagBits::eStorage;
+        default:
+          return {};
+        }
+    }
+
+    void cull()
+    {
+      std::vector<bool> isNeeded(resources.size());
+
+      for (uint32_t i(0u); i < resources.size(); ++i)
+        isNeeded[i] = resources[i].isImported || resources[i].isOutput;
+      for (auto pass(passes.rbegin()); pass != passes.rend(); ++pass)
+        {
+          pass->isAlive = std::any_of(pass->uses.begin(), pass->uses.end(), [&](Use const &use) { return use.isWrite && isNeeded[use.resource]; });
+          if (pass->isAlive)
+            for (auto const &use : pass->uses)
+              if (use.readsPrevious)
+                isNeeded[use.resource] = true;
+        }
+    }
+
+    void allocateTransientImages()
+    {
+      std::vector<std::optional<std::pair<uint32_t, uint32_t>>> lifetimes(resources.size());
+      std::vector<vk::ImageUsageFlags> usages(resources.size());
+
+      for (uint32_t i(0u); i < passes.size(); ++i)
+        if (passes[i].isAlive)
+          for (auto const &use : passes[i].uses)
+            {
+              auto &lifetime(lifetimes[use.resource]);
+
+              lifetime = lifetime ? std::make_pair(lifetime->first, i) : std::make_pair(i, i);
+              usages[use.resource] |= getImageUsage(use.layout);
+            }
+
+      std::vector<std::pair<vk::MemoryRequirements, ResourceId>> requirements;
+
+      for (ResourceId i(0u); i < resources.size(); ++i)
+        {
+          Resource &resource(resources[i]);
+
+          if (!resource.isImage || resource.isImported || !lifetimes[i])
+            continue;
+          resource.ownedImage = device.createImage2D({},
+                                                     resource.desc.format,
+                                                     {resource.desc.extent.width, resource.desc.extent.height},
+                                                     resource.desc.samples,
+                                                     vk::ImageTiling::eOptimal,
+                                                     usages[i] | resource.desc.extraUsage,
+                                                     vk::ImageLayout::eUndefined);
+          resource.image = resource.ownedImage;
+          requirements.emplace_back(device.getImageMemoryRequirements(resource.image), i);
+        }
+      // biggest images first, so that smaller ones fill the slots they leave free
+      std::sort(requirements.begin(), requirements.end(), [](auto const &lh, auto const &rh) { return lh.first.size > rh.first.size; });
+      for (auto const &[memRequirements, id] : requirements)
+        {
+          auto const lifetime(*lifetimes[id]);
+          auto const slot(std::find_if(memorySlots.begin(), memorySlots.end(), [&](MemorySlot const &slot) {
+            return slot.size >= memRequirements.size && (slot.memoryTypeBits & memRequirements.memoryTypeBits)
+                   && std::none_of(slot.lifetimes.begin(), slot.lifetimes.end(), [&](auto const &other) {
+                        return other.first <= lifetime.second && lifetime.first <= other.second;
+                      });
+          }));
+
+          if (slot == memorySlots.end())
+            memorySlots.push_back({{}, memRequirements.size, memRequirements.memoryTypeBits, {lifetime}, {}, {}, {}});
+          else
+            {
+              slot->memoryTypeBits &= memRequirements.memoryTypeBits;
+              slot->lifetimes.push_back(lifetime);
+            }
+          resources[id].memorySlot = static_cast<uint32_t>(slot == memorySlots.end() ? memorySlots.size() - 1 : slot - memorySlots.begin());
+        }
+      for (auto &slot : memorySlots)
+        slot.deviceMemory = device.createDeviceMemory(
+          slot.size, selectDeviceMemoryType(physicalDevice, slot.size, vk::MemoryPropertyFlagBits::eDeviceLocal, slot.memoryTypeBits));
+      for (auto &resource : resources)
+        if (resource.memorySlot)
+          {
+            device.bindImageMemory(resource.image, memorySlots[*resource.memorySlot].deviceMemory, 0);
+            resource.ownedView = device.createImageView({},
+                                                        resource.image,
+                                                        vk::ImageViewType::e2D,
+                                                        resource.desc.format,
+                                                        {vk::ComponentSwizzle::eIdentity,
+                                                         vk::ComponentSwizzle::eIdentity,
+                                                         vk::ComponentSwizzle::eIdentity,
+                                                         vk::ComponentSwizzle::eIdentity},
+                                                        {resource.desc.aspect, 0, 1, 0, 1});
+            resource.view = resource.ownedView;
+          }
+    }
+
+    /// whether the content of `resource` after pass `passIndex` is used by a later pass, or outlives the graph
+    bool isReadAfter(ResourceId resource, uint32_t passIndex) const
+    {
+      if (resources[resource].isImported || resources[resource].isOutput)
+        return true;
+      for (uint32_t i(passIndex + 1u); i < passes.size(); ++i)
+        if (passes[i].isAlive)
+          for (auto const &use : passes[i].uses)
+            if (use.resource == resource)
+              {
+                if (use.readsPrevious)
+                  return true;
+                if (use.isWrite)
+                  return false;
+              }
+      return false;
+    }
+
+    void createRenderPass(uint32_t passIndex)
+    {
+      Pass &pass(passes[passIndex]);
+      RenderPassCreateInfo createInfo(vk::RenderPassCreateFlags{});
+      std::vector<vk::AttachmentReference> colorReferences;
+      vk::AttachmentReference depthReference;
+      auto const addAttachment([&](Attachment const &attachment, vk::ImageLayout layout) {
+        Resource const &resource(resources[attachment.resource]);
+        vk::AttachmentStoreOp const storeOp(isReadAfter(attachment.resource, passIndex) ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare);
+
+        createInfo.attachements.push_back({{},
+                                           resource.desc.format,
+                                           resource.desc.samples,
+                                           attachment.loadOp,
+                                           storeOp,
+                                           attachment.loadOp,
+                                           storeOp,
+                                           layout,
+                                           layout});
+        return vk::AttachmentReference{static_cast<uint32_t>(createInfo.attachements.size() - 1), layout};
+      });
+
+      for (auto const &attachment : pass.colorAttachments)
+        colorReferences.push_back(addAttachment(attachment, vk::ImageLayout::eColorAttachmentOptimal));
+      if (pass.depthAttachment)
+        depthReference = addAttachment(*pass.depthAttachment, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+      createInfo.subPasses.push_back({{},
+                                      vk::PipelineBindPoint::eGraphics,
+                                      0,
+                                      nullptr,
+                                      static_cast<uint32_t>(colorReferences.size()),
+                                      colorReferences.data(),
+                                      nullptr,
+                                      pass.depthAttachment ? &depthReference : nullptr,
+                                      0,
+                                      nullptr});
+      pass.renderPass = device.createRenderPass(createInfo);
+      pass.framebuffers.clear();
+    }
+
+    /// adds the barrier `use` needs after what was previously done to its resource
+    void synchronize(BarrierBatcher &barriers, std::vector<ResourceState> &states, Use const &use)
+    {
+      Resource const &resource(resources[use.resource]);
+      ResourceState &state(states[use.resource]);
+      bool const changesLayout(resource.isImage && state.layout != use.layout);
+      vk::PipelineStageFlags srcStages;
+      vk::AccessFlags srcAccess;
+
+      if (use.isWrite || changesLayout)
+        {
+          srcStages = state.writeStages | state.readStages;
+          srcAccess = state.writeAccess;
+        }
+      else if (state.writeStages && (use.stages & ~state.readStages))
+        {
+          srcStages = state.writeStages;
+          srcAccess = state.writeAccess;
+        }
+      if (changesLayout && state.layout == vk::ImageLayout::eUndefined && resource.memorySlot)
+        {
+          // the memory may still be in use by the image that had it before
+          MemorySlot const &slot(memorySlots[*resource.memorySlot]);
+
+          srcStages |= slot.lastStages;
+          srcAccess |= slot.lastAccess;
+        }
+      if (srcStages || changesLayout)
+        {
+          if (!resource.isImage)
+            barriers.addBufferBarrier(srcStages,
+                                      use.stages,
+                                      {srcAccess, use.access, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, resource.buffer, 0, VK_WHOLE_SIZE});
+          else if (changesLayout || srcAccess)
+            barriers.addImageBarrier(srcStages,
+                                     use.stages,
+                                     {srcAccess,
+                                      use.access,
+                                      state.layout,
+                                      use.layout,
+                                      VK_QUEUE_FAMILY_IGNORED,
+                                      VK_QUEUE_FAMILY_IGNORED,
+                                      resource.image,
+                                      {resource.desc.aspect, 0, 1, 0, 1}});
+          else
+            barriers.addMemoryBarrier(srcStages, use.stages, {}, {});
+        }
+      if (use.isWrite || changesLayout)
+        {
+          state.layout = use.layout;
+          state.writeStages = use.isWrite ? use.stages : vk::PipelineStageFlags{};
+          state.writeAccess = use.isWrite ? use.access : vk::AccessFlags{};
+          state.readStages = use.isWrite ? vk::PipelineStageFlags{} : use.stages;
+        }
+      else
+        state.readStages |= use.stages;
+      if (resource.memorySlot)
+        {
+          MemorySlot &slot(memorySlots[*resource.memorySlot]);
+
+          if (slot.lastResource != use.resource)
+            {
+              slot.lastResource = use.resource;
+              slot.lastStages = {};
+              slot.lastAccess = {};
+            }
+          slot.lastStages |= use.stages;
+          if (use.isWrite)
+            slot.lastAccess |= use.access;
+        }
+    }
+
+    PassId pushPass(Pass &&pass)
+    {
+      passes.push_back(std::move(pass));
+      return static_cast<PassId>(passes.size() - 1);
+    }
+
+  public:
+    FrameGraph(Device<claws::no_delete> device, vk::PhysicalDevice physicalDevice)
+      : device(device)
+      , physicalDevice(physicalDevice)
+    {}
+
+    FrameGraph(FrameGraph const &) = delete;
+    FrameGraph(FrameGraph &&) = default;
+
+    FrameGraph &operator=(FrameGraph const &) = delete;
+    FrameGraph &operator=(FrameGraph &&) = default;
+
+    /// \brief Declares an image that only lives during the frame, created by `compile`
+    ResourceId createImage(ImageDesc const &desc)
+    {
+      return addResource({true, false, false, desc, vk::ImageLayout::eUndefined, vk::ImageLayout::eUndefined, nullptr, nullptr, nullptr, {}, {}, {}});
+    }
+
+    ///
+    /// \brief Declares an image owned by the caller, such as a swapchain image
+    ///
+    /// The image is expected in `initialLayout` when `execute` starts, and is left in `finalLayout`.
+    /// The image and its view are given with `setImportedImage`, and can change between executions.
+    ///
+    ResourceId importImage(ImageDesc const &desc, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout)
+    {
+      return addResource({true, true, false, desc, initialLayout, finalLayout, nullptr, nullptr, nullptr, {}, {}, {}});
+    }
+
+    /// \brief Sets the image and view of an imported image for the next executions, e.g. the swapchain image acquired for the frame
+    void setImportedImage(ResourceId resource, vk::Image image, vk::ImageView view)
+    {
+      resources[resource].image = image;
+      resources[resource].view = view;
+    }
+
+    ///
+    /// \brief Destroys the cached framebuffers using `view`, to call before `view` is destroyed, e.g. when the swapchain is recreated
+    ///
+    /// Framebuffers are cached per set of attachment views, so imported views that alternate, like swapchain images, reuse theirs.
+    /// They are retired to the deletion queue if one was set, otherwise the device is waited on first.
+    ///
+    void forgetImageView(vk::ImageView view)
+    {
+      std::vector<Framebuffer<>> staleFramebuffers;
+
+      for (auto &pass : passes)
+        for (auto it(pass.framebuffers.begin()); it != pass.framebuffers.end();)
+          if (std::find(it->first.begin(), it->first.end(), view) != it->first.end())
+            {
+              staleFramebuffers.push_back(std::move(it->second));
+              it = pass.framebuffers.erase(it);
+            }
+          else
+            ++it;
+      if (!staleFramebuffers.empty())
+        retire(std::move(staleFramebuffers));
+    }
+
+    /// \brief Lets `forgetImageView` and `compile` hand the objects they replace to `deletionQueue`, which the caller collects, `nullptr` to wait idle instead
+    void setDeletionQueue(DeletionQueue *deletionQueue) noexcept
+    {
+      this->deletionQueue = deletionQueue;
+    }
+
+    ResourceId importBuffer(vk::Buffer buffer)
+    {
+      return addResource({false, true, false, {}, vk::ImageLayout::eUndefined, vk::ImageLayout::eUndefined, nullptr, nullptr, buffer, {}, {}, {}});
+    }
+
+    /// \brief Keeps the passes writing `resource` alive, even if no other pass reads it
+    void markOutput(ResourceId resource)
+    {
+      resources[resource].isOutput = true;
+    }
+
+    ///
+    /// \brief Adds a pass recorded inside a render pass, made of its color and depth attachments
+    ///
+    /// `record` is called with the render pass begun, with `vk::SubpassContents::eInline`.
+    ///
+    PassId addRenderPass(std::function<void(PrimaryCommandBuffer const &, RenderPassExecLock const &)> &&record)
+    {
+      return pushPass({std::move(record), {}, {}, {}, {}, false, {}, {}});
+    }
+
+    /// \brief Adds a pass recorded outside of any render pass, e.g. for dispatches or copies
+    PassId addPass(std::function<void(PrimaryCommandBuffer const &)> &&record)
+    {
+      return pushPass({{}, std::move(record), {}, {}, {}, false, {}, {}});
+    }
+
+    void addColorAttachment(PassId pass, ResourceId resource, vk::AttachmentLoadOp loadOp, vk::ClearValue clearValue = {})
+    {
+      bool const load(loadOp == vk::AttachmentLoadOp::eLoad);
+
+      passes[pass].colorAttachments.push_back({resource, loadOp, clearValue});
+      passes[pass].uses.push_back({resource,
+                                   vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                                   vk::AccessFlagBits::eColorAttachmentWrite | (load ? vk::AccessFlagBits::eColorAttachmentRead : vk::AccessFlags{}),
+                                   vk::ImageLayout::eColorAttachmentOptimal,
+                                   true,
+                                   load});
+    }
+
+    void setDepthAttachment(PassId pass, ResourceId resource, vk::AttachmentLoadOp loadOp, vk::ClearValue clearValue = {})
+    {
+      passes[pass].depthAttachment = Attachment{resource, loadOp, clearValue};
+      passes[pass].uses.push_back({resource,
+                                   vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+                                   vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                                   vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                                   true,
+                                   loadOp == vk::AttachmentLoadOp::eLoad});
+    }
+
+    /// \brief Declares that `pass` samples `resource` from `stages`
+    void readImage(PassId pass, ResourceId resource, vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eFragmentShader)
+    {
+      passes[pass].uses.push_back({resource, stages, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal, false, true});
+    }
+
+    /// \brief Declares that `pass` reads and writes `resource` as a storage image from `stages`
+    void writeStorageImage(PassId pass, ResourceId resource, vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eComputeShader)
+    {
+      passes[pass].uses.push_back(
+        {resource, stages, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral, true, true});
+    }
+
+    void readBuffer(PassId pass, ResourceId resource, vk::PipelineStageFlags stages, vk::AccessFlags access)
+    {
+      passes[pass].uses.push_back({resource, stages, access, vk::ImageLayout::eUndefined, false, true});
+    }
+
+    /// \brief Declares a buffer write, `access` includes read bits when the previous content is used
+    void writeBuffer(PassId pass, ResourceId resource, vk::PipelineStageFlags stages, vk::AccessFlags access)
+    {
+      passes[pass].uses.push_back({resource, stages, access, vk::ImageLayout::eUndefined, true, isReadAccess(access)});
+    }
+
+    ///
+    /// \brief Culls passes, and creates transient images and render passes
+    ///
+    /// Must be called again after the graph or an image description changes.
+    /// The images, memory, render passes and framebuffers of the previous compilation may still be used by frames in flight:
+    /// they are retired to the deletion queue if one was set, otherwise the device is waited on before they are destroyed.
+    ///
+    void compile()
+    {
+      Compiled previous;
+
+      for (auto &resource : resources)
+        if (!resource.isImported)
+          {
+            if (vk::Image(resource.ownedImage))
+              {
+                previous.views.push_back(std::move(resource.ownedView));
+                previous.images.push_back(std::move(resource.ownedImage));
+              }
+            resource.ownedView = {};
+            resource.ownedImage = {};
+            resource.image = nullptr;
+            resource.view = nullptr;
+            resource.memorySlot.reset();
+          }
+      for (auto &pass : passes)
+        {
+          for (auto &framebuffer : pass.framebuffers)
+            previous.framebuffers.push_back(std::move(framebuffer.second));
+          pass.framebuffers.clear();
+          if (vk::RenderPass(pass.renderPass))
+            previous.renderPasses.push_back(std::move(pass.renderPass));
+          pass.renderPass = {};
+        }
+      previous.memorySlots.swap(memorySlots);
+      if (!previous.memorySlots.empty() || !previous.renderPasses.empty() || !previous.framebuffers.empty())
+        retire(std::move(previous));
+      cull();
+      allocateTransientImages();
+      for (uint32_t i(0u); i < passes.size(); ++i)
+        if (passes[i].isAlive && passes[i].recordRenderPass)
+          createRenderPass(i);
+    }
+
+    bool isAlive(PassId pass) const noexcept
+    {
+      return passes[pass].isAlive;
+    }
+
+    /// \brief Returns the view of an image, e.g. to write descriptor sets of passes sampling it
+    vk::ImageView getImageView(ResourceId resource) const noexcept
+    {
+      return resources[resource].view;
+    }
+
+    /// \brief Records every live pass on `commandBuffer`, in order, along with the barriers between them
+    void execute(PrimaryCommandBuffer commandBuffer)
+    {
+      std::vector<ResourceState> states(resources.size());
+      BarrierBatcher barriers;
+
+      for (uint32_t i(0u); i < resources.size(); ++i)
+        states[i].layout = resources[i].initialLayout;
+      for (auto &slot : memorySlots)
+        {
+          slot.lastResource.reset();
+          slot.lastStages = {};
+          slot.lastAccess = {};
+        }
+      for (auto &pass : passes)
+        {
+          if (!pass.isAlive)
+            continue;
+          for (auto const &use : pass.uses)
+            synchronize(barriers, states, use);
+          if (!pass.recordRenderPass)
+            {
+              barriers.flush(commandBuffer.raw());
+              pass.record(commandBuffer);
+              continue;
+            }
+
+          assert(!pass.colorAttachments.empty() || pass.depthAttachment);
+
+          std::vector<vk::ImageView> views;
+          std::vector<vk::ClearValue> clearValues;
+
+          for (auto const &attachment : pass.colorAttachments)
+            {
+              views.push_back(resources[attachment.resource].view);
+              clearValues.push_back(attachment.clearValue);
+            }
+          if (pass.depthAttachment)
+            {
+              views.push_back(resources[pass.depthAttachment->resource].view);
+              clearValues.push_back(pass.depthAttachment->clearValue);
+            }
+
+          vk::Extent2D const extent(resources[pass.colorAttachments.empty() ? pass.depthAttachment->resource : pass.colorAttachments.front().resource].desc.extent);
+          auto framebuffer(pass.framebuffers.find(views));
+
+          if (framebuffer == pass.framebuffers.end())
+            framebuffer = pass.framebuffers.emplace(views, device.createFramebuffer(pass.renderPass, views, extent.width, extent.height, 1)).first;
+
+          auto const renderPassExecLock(
+            commandBuffer.beginRenderPass(barriers, pass.renderPass, framebuffer->second, {{0, 0}, extent}, clearValues, vk::SubpassContents::eInline));
+
+          pass.recordRenderPass(commandBuffer, renderPassExecLock);
+        }
+      for (uint32_t i(0u); i < resources.size(); ++i)
+        if (resources[i].isImported && resources[i].isImage && states[i].layout != resources[i].finalLayout)
+          barriers.addImageBarrier(states[i].writeStages | states[i].readStages,
+                                   vk::PipelineStageFlagBits::eBottomOfPipe,
+                                   {states[i].writeAccess,
+                                    {},
+                                    states[i].layout,
+                                    resources[i].finalLayout,
+                                    VK_QUEUE_FAMILY_IGNORED,
+                                    VK_QUEUE_FAMILY_IGNORED,
+                                    resources[i].image,
+                                    {resources[i].desc.aspect, 0, 1, 0, 1}});
+      barriers.flush(commandBuffer.raw());
+    }
+  };
+};
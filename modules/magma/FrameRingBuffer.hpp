@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "magma/Buffer.hpp"
+#include "magma/DeviceMemory.hpp"
+#include "magma/Fence.hpp"
+#include "magma/TimelineSemaphore.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Persistently mapped ring buffer for data that is written once per frame
+  ///
+  /// The buffer is split into one region per frame in flight.
+  /// Allocating bumps an offset in the current region, and the whole region is reclaimed once the fence of the frame that last used it signals.
+  ///
+  /// Typical frame:
+  /// - `allocate` and write per-frame data
+  /// - `flush`, before submitting
+  /// - submit with a fence, then pass that fence to `nextFrame`
+  ///
+  /// Fences passed to `nextFrame` must not be reset before the ring comes back to their region,
+  /// which is the case when frame fences are reset right before being submitted.
+  /// Frames can also be tracked with a single `TimelineSemaphore`, by passing the value each frame signals instead of a fence.
+  ///
+  class FrameRingBuffer
+  {
+  public:
+    struct Allocation
+    {
+      Buffer<claws::no_delete> buffer;
+      vk::DeviceSize offset;
+      void *data;
+    };
+
+  private:
+    Device<claws::no_delete> device;
+    Buffer<> buffer;
+    DeviceMemory<> deviceMemory;
+    char *mapping;
+    vk::DeviceSize memorySize;
+    vk::DeviceSize regionSize;
+    vk::DeviceSize nonCoherentAtomSize;
+    vk::DeviceSize offsetAlignment;
+    bool isCoherent;
+    std::vector<vk::Fence> regionFences;
+    std::vector<uint64_t> regionValues;
+    uint32_t currentRegion;
+    vk::DeviceSize head;
+    vk::DeviceSize flushedHead;
+
+  public:
+    FrameRingBuffer(Device<claws::no_delete> device,
+                    vk::PhysicalDevice physicalDevice,
+                    vk::BufferUsageFlags usage,
+                    vk::DeviceSize regionSize,
+                    uint32_t regionCount,
+                    vk::MemoryPropertyFlags memoryFlags = vk::MemoryPropertyFlagBits::eHostVisible)
+      : device(device)
+      , regionFences(regionCount, nullptr)
+      , regionValues(regionCount, 0u)
+      , currentRegion(0u)
+      , head(0u)
+      , flushedHead(0u)
+    {
+      auto const limits(physicalDevice.getProperties().limits);
+
+      nonCoherentAtomSize = limits.nonCoherentAtomSize;
+      offsetAlignment = getMinOffsetAlignment(limits, usage);
+
+      vk::DeviceSize const regionAlignment(std::max(nonCoherentAtomSize, offsetAlignment));
+
+      this->regionSize = (regionSize + regionAlignment - 1) / regionAlignment * regionAlignment;
+      buffer = device.createBuffer({}, this->regionSize * regionCount, usage);
+
+      auto const memRequirements(device.getBufferMemoryRequirements(buffer));
+      auto const typeIndex(selectDeviceMemoryType(physicalDevice, memRequirements.size, memoryFlags, memRequirements.memoryTypeBits));
+
+      isCoherent = bool(physicalDevice.getMemoryProperties().memoryTypes[typeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+      memorySize = memRequirements.size;
+      deviceMemory = device.createDeviceMemory(memRequirements.size, typeIndex);
+      device.bindBufferMemory(buffer, deviceMemory, 0);
+      mapping = static_cast<char *>(device.mapMemory(deviceMemory, 0, VK_WHOLE_SIZE));
+    }
+
+    FrameRingBuffer(FrameRingBuffer const &) = delete;
+    FrameRingBuffer(FrameRingBuffer &&) = default;
+
+    FrameRingBuffer &operator=(FrameRingBuffer const &) = delete;
+    FrameRingBuffer &operator=(FrameRingBuffer &&) = default;
+
+    /// \brief Allocates `size` bytes from the current frame's region, aligned for the buffer's usage
+    Allocation allocate(vk::DeviceSize size)
+    {
+      return allocate(size, offsetAlignment);
+    }
+
+    ///
+    /// \brief Allocates `size` bytes from the current frame's region, at an offset that is a multiple of `alignment`
+    ///
+    /// `alignment` must be a power of two.
+    /// @throw std::runtime_error if the region is full.
+    ///
+    Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+    {
+      vk::DeviceSize const regionBegin(currentRegion * regionSize);
+      vk::DeviceSize const offset((regionBegin + head + alignment - 1) & ~(alignment - 1));
+
+      if (offset + size > regionBegin + regionSize)
+        throw std::runtime_error("Frame region is full");
+      head = offset + size - regionBegin;
+      return {buffer, offset, mapping + offset};
+    }
+
+    /// \brief Makes what was written since the last flush visible to the device, a no-op on host coherent memory
+    void flush()
+    {
+      if (!isCoherent && head != flushedHead)
+        {
+          vk::DeviceSize const regionBegin(currentRegion * regionSize);
+          vk::DeviceSize const begin((regionBegin + flushedHead) & ~(nonCoherentAtomSize - 1));
+          vk::DeviceSize const end(std::min((regionBegin + head + nonCoherentAtomSize - 1) & ~(nonCoherentAtomSize - 1), memorySize));
+
+          device.flushMappedMemoryRanges({vk::MappedMemoryRange{deviceMemory, begin, end - begin}});
+        }
+      flushedHead = head;
+    }
+
+    ///
+    /// \brief Moves on to the next frame's region
+    ///
+    /// `fence` must signal once the device is done with the current frame's allocations.
+    /// Waits for the next region's fence if the device might still be using it.
+    ///
+    void nextFrame(Fence<claws::no_delete> fence)
+    {
+      regionFences[currentRegion] = fence;
+      currentRegion = (currentRegion + 1) % static_cast<uint32_t>(regionFences.size());
+      head = 0u;
+      flushedHead = 0u;
+      if (regionFences[currentRegion])
+        {
+          device.waitForFences({regionFences[currentRegion]}, true, ~0ull);
+          regionFences[currentRegion] = nullptr;
+        }
+    }
+
+    ///
+    /// \brief Moves on to the next frame's region
+    ///
+    /// `timeline` must reach `value` once the device is done with the current frame's allocations, and be the same for every frame.
+    /// Waits for the value the next region was left with if the device might still be using it.
+    ///
+    void nextFrame(TimelineSemaphore const &timeline, uint64_t value)
+    {
+      regionValues[currentRegion] = value;
+      currentRegion = (currentRegion + 1) % static_cast<uint32_t>(regionFences.size());
+      head = 0u;
+      flushedHead = 0u;
+      if (regionValues[currentRegion])
+        {
+          timeline.wait(regionValues[currentRegion]);
+          regionValues[currentRegion] = 0u;
+        }
+    }
+
+    Buffer<claws::no_delete> getBuffer()
+    {
+      return buffer;
+    }
+  };
+};
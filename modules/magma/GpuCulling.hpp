@@ -0,0 +1,201 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "magma/BarrierBatcher.hpp"
+#include "magma/CommandBuffer.hpp"
+#include "magma/DescriptorSetLayout.hpp"
+#include "magma/DescriptorSets.hpp"
+#include "magma/DynamicBuffer.hpp"
+#include "magma/ImageView.hpp"
+#include "magma/Pipeline.hpp"
+#include "magma/PipelineLayout.hpp"
+#include "magma/Sampler.hpp"
+#include "magma/ShaderModule.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Culls draws on the GPU, against the view frustum and the previous frame's depth pyramid
+  ///
+  /// `record` dispatches a compute shader that tests one bounding sphere per draw, and appends the draws that survive
+  /// to a compacted `vk::DrawIndexedIndirectCommand` buffer, counting them in a `uint32_t`.
+  /// The graphics pass then consumes both with a single `IndexedIndirectDrawList::recordCount`.
+  ///
+  /// The shader is supplied by the caller, `shaders/GpuCulling.comp` is a reference implementation of the expected interface:
+  ///  - binding 0: bounding spheres, as `vec4(center, radius)` in world space, one per draw,
+  ///  - binding 1: the draws to cull,
+  ///  - binding 2: the compacted draws,
+  ///  - binding 3: the draw count,
+  ///  - binding 4: the depth pyramid, as a combined image sampler,
+  ///  - push constants: `Params`.
+  /// Buffers must be created with `vk::BufferUsageFlagBits::eStorageBuffer`, the output ones with `eIndirectBuffer` and `eTransferDst` too.
+  /// Draws are copied as they are: draws that need to know which object they belong to should carry its index in `firstInstance`.
+  ///
+  /// A descriptor set is kept per frame in flight, and `record` rewrites the one it used `frameCount` calls before:
+  /// the command buffer that call was recorded in must have completed, e.g. by calling `record` once per frame,
+  /// after waiting on the fence of the frame that used the same frame in flight index.
+  ///
+  class GpuCulling
+  {
+  public:
+    /// \brief The push constants of the culling shader, 112 bytes
+    struct Params
+    {
+      std::array<float, 16> view;    ///< world to view space transform, column major, looking down +Z, without scaling
+      float p00;                     ///< projection[0][0]
+      float p11;                     ///< projection[1][1]
+      float zNear;
+      float zFar;
+      std::array<float, 4> frustum;  ///< the normalized left/right and top/bottom planes in view space, as (x.x, x.z, y.y, y.z)
+      float pyramidWidth;            ///< the size of the depth pyramid's first level, in texels
+      float pyramidHeight;
+      uint32_t drawCount;
+      uint32_t occlusionEnabled;     ///< 0 to only cull against the frustum, e.g. on the first frame
+    };
+
+    static constexpr uint32_t groupSize = 64u;
+
+  private:
+    Device<claws::no_delete> device;
+    DescriptorSetLayout<> descriptorSetLayout;
+    PipelineLayout<> pipelineLayout;
+    Pipeline<> pipeline;
+    DescriptorPool<> descriptorPool;
+    DescriptorSets<> descriptorSets;
+    uint32_t currentSet;
+
+    static vk::DescriptorBufferInfo getBufferInfo(DynamicBuffer &buffer, DynamicBuffer::RangeId range, vk::DeviceSize size)
+    {
+      return {buffer.getBuffer(range), range.second, size};
+    }
+
+  public:
+    GpuCulling(Device<claws::no_delete> device, ShaderModule<claws::no_delete> cullingShader, uint32_t frameCount)
+      : device(device)
+      , descriptorSetLayout(device.createDescriptorSetLayout(
+          {{0u, vk::DescriptorType::eStorageBuffer, 1u, vk::ShaderStageFlagBits::eCompute, nullptr},
+           {1u, vk::DescriptorType::eStorageBuffer, 1u, vk::ShaderStageFlagBits::eCompute, nullptr},
+           {2u, vk::DescriptorType::eStorageBuffer, 1u, vk::ShaderStageFlagBits::eCompute, nullptr},
+           {3u, vk::DescriptorType::eStorageBuffer, 1u, vk::ShaderStageFlagBits::eCompute, nullptr},
+           {4u, vk::DescriptorType::eCombinedImageSampler, 1u, vk::ShaderStageFlagBits::eCompute, nullptr}}))
+      , pipelineLayout(device.createPipelineLayout({}, {descriptorSetLayout}, {{vk::ShaderStageFlagBits::eCompute, 0u, sizeof(Params)}}))
+      , pipeline(device.createComputePipeline(ComputePipelineConfig({}, cullingShader, "main", pipelineLayout)))
+      , descriptorPool(device.createDescriptorPool(
+          frameCount, {{vk::DescriptorType::eStorageBuffer, 4u * frameCount}, {vk::DescriptorType::eCombinedImageSampler, frameCount}}))
+      , descriptorSets(descriptorPool.allocateDescriptorSets(std::vector<vk::DescriptorSetLayout>(frameCount, descriptorSetLayout)))
+      , currentSet(0u)
+    {}
+
+    GpuCulling(GpuCulling const &) = delete;
+    GpuCulling(GpuCulling &&) = delete;
+
+    GpuCulling &operator=(GpuCulling const &) = delete;
+    GpuCulling &operator=(GpuCulling &&) = delete;
+
+    ///
+    /// \brief Records the culling of `params.drawCount` draws, outside of any render pass
+    ///
+    /// Waits for previous indirect draws to be done reading the outputs, clears the count, dispatches the culling shader,
+    /// and makes its results visible to indirect draws.
+    /// With no draws, only the count is cleared.
+    /// `depthPyramid` must be in `eShaderReadOnlyOptimal`, and hold the farthest depth of each texel's footprint in the previous frame's depth buffer.
+    /// The reference shader tests each draw against the maximum of the 2x2 texels its bounds overlap, at the level where they span at most one texel,
+    /// fetching them without filtering: any sampler can be given, and draws too wide for the pyramid's smallest level are never occluded.
+    /// When occlusion culling is disabled, any image view of the right type can be given.
+    ///
+    void record(CommandBuffer &commandBuffer,
+                Params const &params,
+                DynamicBuffer &bounds,
+                DynamicBuffer::RangeId boundsRange,
+                DynamicBuffer &draws,
+                DynamicBuffer::RangeId drawsRange,
+                DynamicBuffer &culledDraws,
+                DynamicBuffer::RangeId culledDrawsRange,
+                DynamicBuffer &drawCount,
+                DynamicBuffer::RangeId drawCountRange,
+                ImageView<claws::no_delete> depthPyramid,
+                Sampler<claws::no_delete> depthPyramidSampler)
+    {
+      vk::DeviceSize const drawsSize(sizeof(vk::DrawIndexedIndirectCommand) * params.drawCount);
+      std::array<vk::DescriptorBufferInfo, 4> const bufferInfos{getBufferInfo(bounds, boundsRange, sizeof(float) * 4u * params.drawCount),
+                                                                getBufferInfo(draws, drawsRange, drawsSize),
+                                                                getBufferInfo(culledDraws, culledDrawsRange, drawsSize),
+                                                                getBufferInfo(drawCount, drawCountRange, sizeof(uint32_t))};
+      BarrierBatcher barriers;
+
+      barriers.addBufferBarrier(vk::PipelineStageFlagBits::eDrawIndirect,
+                                vk::PipelineStageFlagBits::eTransfer,
+                                {vk::AccessFlagBits::eIndirectCommandRead,
+                                 vk::AccessFlagBits::eTransferWrite,
+                                 VK_QUEUE_FAMILY_IGNORED,
+                                 VK_QUEUE_FAMILY_IGNORED,
+                                 bufferInfos[3].buffer,
+                                 bufferInfos[3].offset,
+                                 bufferInfos[3].range});
+      if (params.drawCount)
+        barriers.addBufferBarrier(vk::PipelineStageFlagBits::eDrawIndirect,
+                                  vk::PipelineStageFlagBits::eComputeShader,
+                                  {vk::AccessFlagBits::eIndirectCommandRead,
+                                   vk::AccessFlagBits::eShaderWrite,
+                                   VK_QUEUE_FAMILY_IGNORED,
+                                   VK_QUEUE_FAMILY_IGNORED,
+                                   bufferInfos[2].buffer,
+                                   bufferInfos[2].offset,
+                                   bufferInfos[2].range});
+      barriers.flush(commandBuffer.raw());
+
+      commandBuffer.fillBuffer(drawCount.getBuffer(drawCountRange), drawCountRange.second, sizeof(uint32_t), 0u);
+      if (!params.drawCount)
+        {
+          barriers.addBufferBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                    vk::PipelineStageFlagBits::eDrawIndirect,
+                                    {vk::AccessFlagBits::eTransferWrite,
+                                     vk::AccessFlagBits::eIndirectCommandRead,
+                                     VK_QUEUE_FAMILY_IGNORED,
+                                     VK_QUEUE_FAMILY_IGNORED,
+                                     bufferInfos[3].buffer,
+                                     bufferInfos[3].offset,
+                                     bufferInfos[3].range});
+          barriers.flush(commandBuffer.raw());
+          return;
+        }
+      barriers.addBufferBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                {vk::AccessFlagBits::eTransferWrite,
+                                 vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                                 VK_QUEUE_FAMILY_IGNORED,
+                                 VK_QUEUE_FAMILY_IGNORED,
+                                 bufferInfos[3].buffer,
+                                 bufferInfos[3].offset,
+                                 bufferInfos[3].range});
+      barriers.flush(commandBuffer.raw());
+
+      vk::DescriptorSet const descriptorSet(static_cast<std::vector<vk::DescriptorSet> const &>(descriptorSets)[currentSet]);
+      vk::DescriptorImageInfo const imageInfo{depthPyramidSampler, depthPyramid, vk::ImageLayout::eShaderReadOnlyOptimal};
+
+      currentSet = (currentSet + 1) % static_cast<uint32_t>(static_cast<std::vector<vk::DescriptorSet> const &>(descriptorSets).size());
+      device.updateDescriptorSets(std::array<vk::WriteDescriptorSet, 2>{
+        vk::WriteDescriptorSet{descriptorSet, 0u, 0u, 4u, vk::DescriptorType::eStorageBuffer, nullptr, bufferInfos.data(), nullptr},
+        vk::WriteDescriptorSet{descriptorSet, 4u, 0u, 1u, vk::DescriptorType::eCombinedImageSampler, &imageInfo, nullptr, nullptr}});
+
+      commandBuffer.bindComputePipeline(pipeline);
+      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0u, {descriptorSet}, {});
+      commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0u, sizeof(Params), &params);
+      commandBuffer.dispatch((params.drawCount + groupSize - 1u) / groupSize, 1u, 1u);
+
+      for (auto const &bufferInfo : {bufferInfos[2], bufferInfos[3]})
+        barriers.addBufferBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eDrawIndirect,
+                                  {vk::AccessFlagBits::eShaderWrite,
+                                   vk::AccessFlagBits::eIndirectCommandRead,
+                                   VK_QUEUE_FAMILY_IGNORED,
+                                   VK_QUEUE_FAMILY_IGNORED,
+                                   bufferInfo.buffer,
+                                   bufferInfo.offset,
+                                   bufferInfo.range});
+      barriers.flush(commandBuffer.raw());
+    }
+  };
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "magma/CommandBuffer.hpp"
+#include "magma/QueryPool.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Measures GPU time with timestamp queries, in named zones
+  ///
+  /// Zones are opened with `zone`, on a command buffer or inside a render pass, and closed when the returned object is destroyed.
+  /// Each frame slot has its own query pool: `beginFrame` reads back the timings of the frame that last used the slot, which has finished by then,
+  /// so reading results never stalls.
+  ///
+  /// `beginFrame` must be called once per frame, outside of any render pass, before any zone is opened,
+  /// and only once the GPU is done with the frame that last used the slot, e.g. right after `CommandPoolManager::nextFrame`.
+  /// Zones opened past the per-frame limit are not measured.
+  ///
+  class GpuProfiler
+  {
+  public:
+    struct ZoneTiming
+    {
+      std::string name;
+      uint32_t depth;  ///< how many zones enclose this one
+      double begin;    ///< milliseconds since the first timestamp of the frame
+      double duration; ///< milliseconds
+    };
+
+    template<class Commands>
+    class Zone
+    {
+      friend class GpuProfiler;
+
+      Commands const *commands;
+      GpuProfiler *profiler;
+      uint32_t endQuery;
+
+      Zone(Commands const &commands, GpuProfiler &profiler, uint32_t endQuery)
+        : commands(&commands)
+        , profiler(&profiler)
+        , endQuery(endQuery)
+      {}
+
+    public:
+      Zone(Zone const &) = delete;
+
+      Zone(Zone &&other)
+        : commands(other.commands)
+        , profiler(other.profiler)
+        , endQuery(other.endQuery)
+      {
+        other.profiler = nullptr;
+      }
+
+      Zone &operator=(Zone const &) = delete;
+      Zone &operator=(Zone &&) = delete;
+
+      ~Zone()
+      {
+        if (!profiler)
+          return;
+        --profiler->depth;
+        if (endQuery != ~0u)
+          commands->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, profiler->frames[profiler->currentFrame].queryPool, endQuery);
+      }
+    };
+
+  private:
+    struct ZoneQueries
+    {
+      std::string name;
+      uint32_t depth;
+      uint32_t beginQuery;
+    };
+
+    struct Frame
+    {
+      QueryPool<> queryPool;
+      std::vector<ZoneQueries> zones;
+      uint32_t queryCount;
+    };
+
+    Device<claws::no_delete> device;
+    std::vector<Frame> frames;
+    uint32_t currentFrame;
+    uint32_t maxZoneCount;
+    uint32_t depth;
+    double timestampPeriod;
+    uint64_t timestampMask;
+    std::vector<ZoneTiming> zoneTimings;
+
+    void readBack(Frame const &frame)
+    {
+      zoneTimings.clear();
+      if (!frame.queryCount)
+        return;
+
+      // each query is followed by its availability, queries that aren't available yet are simply not reported
+      std::vector<uint64_t> results(frame.queryCount * 2u);
+
+      static_cast<void>(device.getQueryPoolResults(frame.queryPool,
+                                                   0u,
+                                                   frame.queryCount,
+                                                   results.size() * sizeof(uint64_t),
+                                                   results.data(),
+                                                   2u * sizeof(uint64_t),
+                                                   vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability));
+
+      uint64_t const origin(results[0]);
+
+      for (auto const &zone : frame.zones)
+        {
+          uint32_t const endQuery(zone.beginQuery + 1u);
+
+          if (!results[1] || !results[zone.beginQuery * 2u + 1u] || !results[endQuery * 2u + 1u])
+            continue;
+
+          uint64_t const begin(results[zone.beginQuery * 2u]);
+          uint64_t const end(results[endQuery * 2u]);
+
+          zoneTimings.push_back({zone.name,
+                                 zone.depth,
+                                 static_cast<double>((begin - origin) & timestampMask) * timestampPeriod / 1e6,
+                                 static_cast<double>((end - begin) & timestampMask) * timestampPeriod / 1e6});
+        }
+    }
+
+  public:
+    ///
+    /// \brief Creates a query pool for each of the `frameCount` frame slots, able to hold `maxZoneCount` zones
+    ///
+    /// Throws if the queue family doesn't support timestamps.
+    ///
+    GpuProfiler(Device<claws::no_delete> device, vk::PhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameCount, uint32_t maxZoneCount = 256u)
+      : device(device)
+      , frames(frameCount)
+      , currentFrame(frameCount - 1u)
+      , maxZoneCount(maxZoneCount)
+      , depth(0u)
+      , timestampPeriod(physicalDevice.getProperties().limits.timestampPeriod)
+    {
+      uint32_t const validBits(physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits);
+
+      if (!validBits)
+        throw std::runtime_error("Queue family doesn't support timestamps");
+      timestampMask = validBits >= 64u ? ~uint64_t(0u) : (uint64_t(1u) << validBits) - 1u;
+      for (auto &frame : frames)
+        {
+          frame.queryPool = device.createQueryPool(vk::QueryType::eTimestamp, 2u * maxZoneCount);
+          frame.queryCount = 0u;
+        }
+    }
+
+    GpuProfiler(GpuProfiler const &) = delete;
+    GpuProfiler(GpuProfiler &&) = delete;
+
+    GpuProfiler &operator=(GpuProfiler const &) = delete;
+    GpuProfiler &operator=(GpuProfiler &&) = delete;
+
+    /// \brief Moves to the next frame slot, reading back its previous timings and resetting its queries
+    void beginFrame(CommandBuffer &commandBuffer)
+    {
+      currentFrame = (currentFrame + 1u) % static_cast<uint32_t>(frames.size());
+
+      Frame &frame(frames[currentFrame]);
+
+      readBack(frame);
+      commandBuffer.resetQueryPool(frame.queryPool, 0u, 2u * maxZoneCount);
+      frame.zones.clear();
+      frame.queryCount = 0u;
+      depth = 0u;
+    }
+
+    ///
+    /// \brief Writes the begin timestamp of a zone, the end one is written when the returned object is destroyed
+    ///
+    /// `commands` is either a `CommandBuffer` or a `RenderPassCommands`, and must outlive the zone.
+    /// A zone begun in a render pass must end in the same subpass.
+    ///
+    template<class Commands>
+    Zone<Commands> zone(Commands const &commands, std::string name)
+    {
+      Frame &frame(frames[currentFrame]);
+
+      ++depth;
+      if (frame.queryCount + 2u > 2u * maxZoneCount)
+        return Zone<Commands>(commands, *this, ~0u);
+      frame.zones.push_back({std::move(name), depth - 1u, frame.queryCount});
+      commands.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.queryPool, frame.queryCount);
+      frame.queryCount += 2u;
+      return Zone<Commands>(commands, *this, frame.queryCount - 1u);
+    }
+
+    /// \brief Returns the timings read back by the last `beginFrame`, in the order the zones were opened
+    std::vector<ZoneTiming> const &getZoneTimings() const noexcept
+    {
+      return zoneTimings;
+    }
+  };
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "magma/Device.hpp"
+#include "magma/DeviceMemory.hpp"
+#include "magma/Image.hpp"
+#include "magma/TlsfAllocator.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Places many images in a few big `DeviceMemory` blocks
+  ///
+  /// Blocks are grouped by memory type, and linear images never share a block with optimal images,
+  /// which keeps them `bufferImageGranularity` apart without padding every allocation.
+  /// Allocations are freed through the returned handle, so the pool must outlive them and cannot be moved.
+  ///
+  class ImageMemoryPool
+  {
+  public:
+    struct Allocation
+    {
+      vk::DeviceMemory memory;
+      vk::DeviceSize offset;
+      uint32_t poolIndex;
+      uint32_t blockIndex;
+    };
+
+    struct Deleter
+    {
+      ImageMemoryPool *pool;
+
+      void operator()(Allocation const &allocation) const
+      {
+        if (pool)
+          pool->free(allocation);
+      }
+    };
+
+  private:
+    struct Block
+    {
+      DeviceMemory<> deviceMemory;
+      TlsfAllocator<vk::DeviceSize> allocator;
+      bool isDedicated;
+    };
+
+    struct Pool
+    {
+      uint32_t memoryTypeIndex;
+      bool isLinear;
+      std::vector<Block> blocks;
+    };
+
+    Device<claws::no_delete> device;
+    vk::PhysicalDevice physicalDevice;
+    vk::MemoryPropertyFlags memoryFlags;
+    vk::DeviceSize blockSize;
+    bool separateLinear;
+    std::optional<vk::DeviceSize> dedicatedThreshold;
+    MemoryTypeSelector *memoryTypeSelector;
+    std::vector<Pool> pools;
+
+    uint32_t getPool(uint32_t memoryTypeIndex, bool isLinear)
+    {
+      isLinear = isLinear && separateLinear;
+      for (uint32_t i(0u); i < pools.size(); ++i)
+        if (pools[i].memoryTypeIndex == memoryTypeIndex && pools[i].isLinear == isLinear)
+          return i;
+      pools.push_back({memoryTypeIndex, isLinear, {}});
+      return static_cast<uint32_t>(pools.size() - 1);
+    }
+
+    void free(Allocation const &allocation)
+    {
+      Block &block(pools[allocation.poolIndex].blocks[allocation.blockIndex]);
+
+      block.allocator.deallocate(allocation.offset);
+      if (!block.allocator.getAllocationCount())
+        block = Block{};
+    }
+
+  public:
+    ImageMemoryPool(Device<claws::no_delete> device,
+                    vk::PhysicalDevice physicalDevice,
+                    vk::MemoryPropertyFlags memoryFlags,
+                    vk::DeviceSize blockSize = vk::DeviceSize(64u) << 20u)
+      : device(device)
+      , physicalDevice(physicalDevice)
+      , memoryFlags(memoryFlags)
+      , blockSize(blockSize)
+      , separateLinear(physicalDevice.getProperties().limits.bufferImageGranularity > 1u)
+      , dedicatedThreshold()
+      , memoryTypeSelector(nullptr)
+      , pools()
+    {}
+
+    ImageMemoryPool(ImageMemoryPool const &) = delete;
+    ImageMemoryPool(ImageMemoryPool &&) = delete;
+
+    ImageMemoryPool &operator=(ImageMemoryPool const &) = delete;
+    ImageMemoryPool &operator=(ImageMemoryPool &&) = delete;
+
+    ///
+    /// \brief Gives images of at least `threshold` bytes, and images the driver wants dedicated memory for, a dedicated allocation
+    ///
+    /// The driver is asked about each image through `getImageMemoryRequirements2`, so this requires Vulkan 1.1 or `VK_KHR_dedicated_allocation`.
+    ///
+    void enableDedicatedAllocations(vk::DeviceSize threshold = ~vk::DeviceSize(0u))
+    {
+      dedicatedThreshold = threshold;
+    }
+
+    ///
+    /// \brief Picks the memory type of new blocks with `memoryTypeSelector`, which accounts for them in its heap usage
+    ///
+    /// `memoryFlags` become required flags, and types whose heap is over budget are skipped.
+    /// `memoryTypeSelector` must outlive the pool's blocks.
+    ///
+    void setMemoryTypeSelector(MemoryTypeSelector *memoryTypeSelector) noexcept
+    {
+      this->memoryTypeSelector = memoryTypeSelector;
+    }
+
+    ///
+    /// \brief Finds memory for `image` in the pool and binds it with `bindImageMemory`
+    ///
+    /// `tiling` must be the tiling `image` was created with.
+    /// Images bigger than the pool's block size get a block of their own.
+    /// @return a handle to the allocation, which gives the memory back to the pool when destroyed.
+    ///
+    auto allocate(Image<claws::no_delete> image, vk::ImageTiling tiling)
+    {
+      vk::MemoryRequirements memRequirements;
+      bool isDedicated(false);
+
+      if (dedicatedThreshold)
+        {
+          auto const requirements(device.getDedicatedMemoryRequirements(image));
+
+          memRequirements = requirements.memoryRequirements;
+          isDedicated = requirements.prefersDedicatedAllocation || requirements.requiresDedicatedAllocation || memRequirements.size >= *dedicatedThreshold;
+        }
+      else
+        memRequirements = device.getImageMemoryRequirements(image);
+
+      uint32_t const memoryTypeIndex(memoryTypeSelector
+                                       ? selectDeviceMemoryType(*memoryTypeSelector, memRequirements.size, memoryFlags, {}, memRequirements.memoryTypeBits)
+                                       : selectDeviceMemoryType(physicalDevice, memRequirements.size, memoryFlags, memRequirements.memoryTypeBits));
+      uint32_t const poolIndex(getPool(memoryTypeIndex, tiling == vk::ImageTiling::eLinear));
+      Pool &pool(pools[poolIndex]);
+      uint32_t blockIndex(0u);
+      std::optional<vk::DeviceSize> offset;
+
+      if (!isDedicated)
+        for (; blockIndex < pool.blocks.size(); ++blockIndex)
+          if (!pool.blocks[blockIndex].isDedicated && (offset = pool.blocks[blockIndex].allocator.allocate(memRequirements.size, memRequirements.alignment)))
+            break;
+      if (!offset)
+        {
+          blockIndex = static_cast<uint32_t>(std::find_if(pool.blocks.begin(), pool.blocks.end(), [](auto const &block) { return !block.deviceMemory; })
+                                             - pool.blocks.begin());
+          if (blockIndex == pool.blocks.size())
+            pool.blocks.emplace_back();
+
+          Block &block(pool.blocks[blockIndex]);
+          vk::DeviceSize const size(isDedicated ? memRequirements.size : std::max(blockSize, memRequirements.size));
+
+          if (isDedicated)
+            block.deviceMemory = device.createDedicatedDeviceMemory(size, pool.memoryTypeIndex, image, memoryTypeSelector);
+          else
+            block.deviceMemory = device.createDeviceMemory(size, pool.memoryTypeIndex, memoryTypeSelector);
+          block.allocator = TlsfAllocator<vk::DeviceSize>(size);
+          block.isDedicated = isDedicated;
+          offset = block.allocator.allocate(memRequirements.size, memRequirements.alignment);
+        }
+
+      claws::handle<Allocation, Deleter> allocation(Deleter{this}, Allocation{pool.blocks[blockIndex].deviceMemory, *offset, poolIndex, blockIndex});
+
+      device.bindImageMemory(image, allocation.memory, allocation.offset);
+      return allocation;
+    }
+  };
+
+  template<class Deleter = ImageMemoryPool::Deleter>
+  using ImageMemory = claws::handle<ImageMemoryPool::Allocation, Deleter>;
+};
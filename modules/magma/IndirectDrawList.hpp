@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "magma/CommandBuffer.hpp"
+#include "magma/DynamicBuffer.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief A list of draws built on the CPU, packed into a `DynamicBuffer` range and recorded as indirect draws
+  ///
+  /// `Command` is either `vk::DrawIndirectCommand` or `vk::DrawIndexedIndirectCommand`.
+  /// The buffer given to `pack` must be host visible, and created with `vk::BufferUsageFlagBits::eIndirectBuffer`.
+  ///
+  template<class Command>
+  class BasicIndirectDrawList
+  {
+    static_assert(std::is_same_v<Command, vk::DrawIndirectCommand> || std::is_same_v<Command, vk::DrawIndexedIndirectCommand>,
+                  "Indirect draw lists hold vk::DrawIndirectCommand or vk::DrawIndexedIndirectCommand");
+
+    std::vector<Command> commands;
+
+    static void recordDraws(RenderPassCommands const &renderPassCommands, Buffer<claws::no_delete> buffer, vk::DeviceSize offset, uint32_t drawCount)
+    {
+      if constexpr (std::is_same_v<Command, vk::DrawIndirectCommand>)
+        renderPassCommands.drawIndirect(buffer, offset, drawCount, sizeof(Command));
+      else
+        renderPassCommands.drawIndexedIndirect(buffer, offset, drawCount, sizeof(Command));
+    }
+
+  public:
+    void add(Command const &command)
+    {
+      commands.push_back(command);
+    }
+
+    uint32_t size() const noexcept
+    {
+      return static_cast<uint32_t>(commands.size());
+    }
+
+    bool empty() const noexcept
+    {
+      return commands.empty();
+    }
+
+    void clear() noexcept
+    {
+      commands.clear();
+    }
+
+    /// \brief Allocates a range of `buffer` and copies every draw to it, the range must be freed by the caller
+    DynamicBuffer::RangeId pack(DynamicBuffer &buffer) const
+    {
+      auto const range(buffer.allocate(sizeof(Command) * commands.size(), alignof(uint32_t)));
+
+      std::memcpy(buffer.getMemory<char[]>(range).get(), commands.data(), sizeof(Command) * commands.size());
+      return range;
+    }
+
+    ///
+    /// \brief Records the `drawCount` draws packed at `range`, in as few indirect draws as `maxDrawCount` allows
+    ///
+    /// Without the `multiDrawIndirect` feature, `maxDrawCount` must be 1, and each draw is recorded on its own.
+    /// Otherwise it should be the device's `maxDrawIndirectCount` limit.
+    ///
+    static void record(RenderPassCommands const &renderPassCommands,
+                       DynamicBuffer &buffer,
+                       DynamicBuffer::RangeId range,
+                       uint32_t drawCount,
+                       uint32_t maxDrawCount = 1u)
+    {
+      for (uint32_t i(0u); i < drawCount; i += maxDrawCount)
+        recordDraws(renderPassCommands, buffer.getBuffer(range), range.second + sizeof(Command) * i, std::min(maxDrawCount, drawCount - i));
+    }
+
+    ///
+    /// \brief Records up to `maxDrawCount` draws packed at `range`, the actual count being the `uint32_t` at `countRange`
+    ///
+    /// Meant for draw lists written by the GPU. Requires Vulkan 1.2 and the `drawIndirectCount` feature.
+    ///
+    static void recordCount(RenderPassCommands const &renderPassCommands,
+                            DynamicBuffer &buffer,
+                            DynamicBuffer::RangeId range,
+                            DynamicBuffer &countBuffer,
+                            DynamicBuffer::RangeId countRange,
+                            uint32_t maxDrawCount)
+    {
+      if constexpr (std::is_same_v<Command, vk::DrawIndirectCommand>)
+        renderPassCommands.drawIndirectCount(
+          buffer.getBuffer(range), range.second, countBuffer.getBuffer(countRange), countRange.second, maxDrawCount, sizeof(Command));
+      else
+        renderPassCommands.drawIndexedIndirectCount(
+          buffer.getBuffer(range), range.second, countBuffer.getBuffer(countRange), countRange.second, maxDrawCount, sizeof(Command));
+    }
+  };
+
+  using IndirectDrawList = BasicIndirectDrawList<vk::DrawIndirectCommand>;
+  using IndexedIndirectDrawList = BasicIndirectDrawList<vk::DrawIndexedIndirectCommand>;
+};
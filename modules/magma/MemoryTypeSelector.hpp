@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <optional>
+
+#include "vulkan/vulkan.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Selects memory types from cached memory properties, keeping track of each heap's usage
+  ///
+  /// Among the types that have all the required flags, the ones missing the fewest preferred flags are picked first.
+  /// Types whose heap would go over budget are skipped, so that allocations fall back to the next best type instead of oversubscribing a heap.
+  /// If `VK_EXT_memory_budget` is enabled, the budget and usage come from the driver and are refreshed by `updateBudget`,
+  /// otherwise the budget is the heap size and the usage is what was allocated through this selector.
+  ///
+  class MemoryTypeSelector
+  {
+    vk::PhysicalDevice physicalDevice;
+    vk::PhysicalDeviceMemoryProperties memoryProperties;
+    bool hasMemoryBudget;
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> heapBudget;
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> heapUsage;
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> allocatedSize;
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> allocatedSizeAtUpdate;
+
+  public:
+    MemoryTypeSelector(vk::PhysicalDevice physicalDevice, bool hasMemoryBudget = false)
+      : physicalDevice(physicalDevice)
+      , memoryProperties(physicalDevice.getMemoryProperties())
+      , hasMemoryBudget(hasMemoryBudget)
+      , heapBudget{}
+      , heapUsage{}
+      , allocatedSize{}
+      , allocatedSizeAtUpdate{}
+    {
+      updateBudget();
+    }
+
+    MemoryTypeSelector(MemoryTypeSelector const &) = delete;
+    MemoryTypeSelector(MemoryTypeSelector &&) = delete;
+
+    MemoryTypeSelector &operator=(MemoryTypeSelector const &) = delete;
+    MemoryTypeSelector &operator=(MemoryTypeSelector &&) = delete;
+
+    ///
+    /// \brief Queries the driver's budget and usage for every heap
+    ///
+    /// Only queries the driver if `VK_EXT_memory_budget` is enabled, which also needs a Vulkan 1.1 instance for `getMemoryProperties2`.
+    /// Budgets change with the rest of the system's memory usage, so this is typically called once per frame.
+    /// Without the extension, nothing is queried and the usage keeps counting every allocation made through this selector.
+    ///
+    void updateBudget()
+    {
+      if (hasMemoryBudget)
+        {
+          auto const properties(physicalDevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>());
+          auto const &budget(properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>());
+
+          for (uint32_t i(0u); i < memoryProperties.memoryHeapCount; ++i)
+            {
+              heapBudget[i] = budget.heapBudget[i];
+              heapUsage[i] = budget.heapUsage[i];
+            }
+          allocatedSizeAtUpdate = allocatedSize;
+        }
+      else
+        for (uint32_t i(0u); i < memoryProperties.memoryHeapCount; ++i)
+          heapBudget[i] = memoryProperties.memoryHeaps[i].size;
+    }
+
+    auto const &getMemoryProperties() const noexcept
+    {
+      return memoryProperties;
+    }
+
+    vk::DeviceSize getHeapBudget(uint32_t heapIndex) const noexcept
+    {
+      return heapBudget[heapIndex];
+    }
+
+    /// \brief Returns the heap usage at the last update, corrected by what was allocated or freed through this selector since
+    vk::DeviceSize getHeapUsage(uint32_t heapIndex) const noexcept
+    {
+      vk::DeviceSize const usage(heapUsage[heapIndex] + allocatedSize[heapIndex]);
+
+      return usage > allocatedSizeAtUpdate[heapIndex] ? usage - allocatedSizeAtUpdate[heapIndex] : 0u;
+    }
+
+    ///
+    /// \brief Selects the best memory type for an allocation of `size` bytes
+    ///
+    /// @return the index of the memory type, or `std::nullopt` if no type has the required flags and room left in its heap's budget.
+    ///
+    std::optional<uint32_t> select(vk::DeviceSize size,
+                                   vk::MemoryPropertyFlags requiredFlags,
+                                   vk::MemoryPropertyFlags preferredFlags,
+                                   uint32_t memoryTypeIndexMask) const
+    {
+      std::optional<uint32_t> best;
+      std::size_t bestCost(~std::size_t(0u));
+
+      for (uint32_t i(0u); i < memoryProperties.memoryTypeCount; ++i)
+        {
+          auto const &type(memoryProperties.memoryTypes[i]);
+
+          if (!((memoryTypeIndexMask >> i) & 1u) || (type.propertyFlags & requiredFlags) != requiredFlags)
+            continue;
+          if (getHeapUsage(type.heapIndex) + size > heapBudget[type.heapIndex])
+            continue;
+
+          std::size_t const cost(std::bitset<32>(static_cast<uint32_t>(preferredFlags & ~type.propertyFlags)).count());
+
+          if (cost < bestCost)
+            {
+              best = i;
+              bestCost = cost;
+            }
+        }
+      return best;
+    }
+
+    void notifyAllocation(uint32_t typeIndex, vk::DeviceSize size) noexcept
+    {
+      allocatedSize[memoryProperties.memoryTypes[typeIndex].heapIndex] += size;
+    }
+
+    void notifyFree(uint32_t typeIndex, vk::DeviceSize size) noexcept
+    {
+      allocatedSize[memoryProperties.memoryTypes[typeIndex].heapIndex] -= size;
+    }
+  };
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "magma/BarrierBatcher.hpp"
+#include "magma/Device.hpp"
+#include "magma/QueueFamily.hpp"
+#include "magma/SubmissionBatcher.hpp"
+#include "magma/TimelineSemaphore.hpp"
+
+namespace magma
+{
+  enum class QueueRole : uint32_t
+  {
+    graphics,
+    compute,
+    transfer
+  };
+
+  ///
+  /// \brief The queue families a device is created with: the graphics one, and the dedicated compute and transfer ones when the device has them
+  ///
+  /// Dedicated compute families (compute without graphics) usually map to async compute hardware queues,
+  /// and dedicated transfer families (transfer without graphics nor compute) to DMA engines, so work submitted to them overlaps with rendering.
+  ///
+  struct QueueFamilies
+  {
+    uint32_t graphics;
+    std::optional<uint32_t> compute;
+    std::optional<uint32_t> transfer;
+
+    /// \brief Looks for dedicated compute and transfer families, next to `graphics` which is typically chosen with `Instance::selectQueue`
+    static QueueFamilies find(vk::PhysicalDevice physicalDevice, uint32_t graphics)
+    {
+      return {graphics,
+              findQueueFamily(physicalDevice, vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics),
+              findQueueFamily(physicalDevice, vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)};
+    }
+
+    /// \brief Returns the family used for `role`, which is the graphics one when there is no dedicated family
+    uint32_t get(QueueRole role) const noexcept
+    {
+      switch (role)
+        {
+        case QueueRole::compute:
+          return compute.value_or(graphics);
+        case QueueRole::transfer:
+          return transfer.value_or(graphics);
+        default:
+          return graphics;
+        }
+    }
+
+    /// \brief Returns one `vk::DeviceQueueCreateInfo` per distinct family, with a single queue each, to create the device with
+    std::vector<vk::DeviceQueueCreateInfo> getQueueCreateInfos() const
+    {
+      static float const priority(1.0f);
+      std::vector<vk::DeviceQueueCreateInfo> createInfos{{{}, graphics, 1u, &priority}};
+
+      for (auto const family : {compute, transfer})
+        if (family)
+          createInfos.push_back({{}, *family, 1u, &priority});
+      return createInfos;
+    }
+  };
+
+  ///
+  /// \brief Schedules work on the graphics, compute and transfer queues, synchronizing them with a timeline semaphore per queue
+  ///
+  /// Each submission signals the next value of its queue's timeline, and waits on the values of the submissions it depends on,
+  /// whichever queue they ran on. Submissions are batched per queue until `flush`, and submissions on different queues overlap.
+  ///
+  /// Resources that are not shared concurrently change queue family ownership when used across families:
+  /// `releaseBuffer` and `releaseImage` are recorded by the source queue, `acquireBuffer` and `acquireImage` by the destination one,
+  /// with matching parameters, the acquiring submission depending on the releasing one.
+  /// When both roles share a family, no transfer is needed: only the layout transition of images is recorded, by the release.
+  ///
+  /// Requires timeline semaphores, see `TimelineSemaphore`. Scheduling is thread-safe.
+  ///
+  class CrossQueueScheduler
+  {
+  public:
+    struct Dependency
+    {
+      QueueRole role;
+      uint64_t value;                ///< the value returned by `schedule` for the submission to wait on
+      vk::PipelineStageFlags stages; ///< the stages of the dependent submission that wait
+    };
+
+  private:
+    struct QueueState
+    {
+      TimelineSemaphore timeline;
+      SubmissionBatcher batcher;
+      uint64_t scheduledValue;
+
+      QueueState(Device<claws::no_delete> device, vk::Queue queue)
+        : timeline(device)
+        , batcher(queue)
+        , scheduledValue(0u)
+      {}
+    };
+
+    QueueFamilies families;
+    std::vector<std::unique_ptr<QueueState>> queueStates;
+    std::array<QueueState *, 3> queues;
+    std::mutex mutex;
+
+    QueueState &getQueue(QueueRole role) const
+    {
+      return *queues[static_cast<uint32_t>(role)];
+    }
+
+  public:
+    ///
+    /// \brief Uses the first queue of each family of `families`, the device must have been created with `families.getQueueCreateInfos()`
+    ///
+    /// Roles without a dedicated family share the graphics queue, and its timeline.
+    ///
+    CrossQueueScheduler(Device<claws::no_delete> device, QueueFamilies const &families)
+      : families(families)
+    {
+      for (auto const role : {QueueRole::graphics, QueueRole::compute, QueueRole::transfer})
+        {
+          QueueState *&queue(queues[static_cast<uint32_t>(role)]);
+
+          queue = role == QueueRole::graphics || families.get(role) != families.graphics ? nullptr : queues[0];
+          if (!queue)
+            {
+              queueStates.push_back(std::make_unique<QueueState>(device, device.getQueue(families.get(role), 0u)));
+              queue = queueStates.back().get();
+            }
+        }
+    }
+
+    CrossQueueScheduler(CrossQueueScheduler const &) = delete;
+    CrossQueueScheduler(CrossQueueScheduler &&) = delete;
+
+    CrossQueueScheduler &operator=(CrossQueueScheduler const &) = delete;
+    CrossQueueScheduler &operator=(CrossQueueScheduler &&) = delete;
+
+    ///
+    /// \brief Queues `commandBuffers` on the queue of `role`, to run once every dependency has completed
+    ///
+    /// Command buffers must come from a pool of the role's family, see `getFamily`.
+    /// @return the timeline value signaled when they complete, to depend on or wait for.
+    ///
+    uint64_t schedule(QueueRole role, std::vector<vk::CommandBuffer> const &commandBuffers, std::vector<Dependency> const &dependencies = {})
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      QueueState &queue(getQueue(role));
+      std::vector<SemaphoreWait> waits;
+
+      for (auto const &dependency : dependencies)
+        waits.push_back(getQueue(dependency.role).timeline.waitAt(dependency.value, dependency.stages));
+      queue.batcher.enqueue(commandBuffers, waits, {queue.timeline.signalAt(++queue.scheduledValue)});
+      return queue.scheduledValue;
+    }
+
+    /// \brief Submits what was scheduled on every queue
+    void flush()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for (auto const &queueState : queueStates)
+        queueState->batcher.flush();
+    }
+
+    /// \brief Returns whether the submission of `role` that signals `value` has completed, without waiting
+    bool isComplete(QueueRole role, uint64_t value) const
+    {
+      return getQueue(role).timeline.getValue() >= value;
+    }
+
+    /// \brief Blocks until the submission of `role` that signals `value` has completed, it must have been flushed
+    void wait(QueueRole role, uint64_t value) const
+    {
+      getQueue(role).timeline.wait(value);
+    }
+
+    /// \brief Returns the timeline of `role`, e.g. for `DeletionQueue::collect`
+    TimelineSemaphore const &getTimeline(QueueRole role) const
+    {
+      return getQueue(role).timeline;
+    }
+
+    uint32_t getFamily(QueueRole role) const noexcept
+    {
+      return families.get(role);
+    }
+
+    /// \brief Records the release half of a buffer ownership transfer from `source` to `destination`, in a command buffer of `source`
+    void releaseBuffer(BarrierBatcher &barriers,
+                       QueueRole source,
+                       QueueRole destination,
+                       vk::Buffer buffer,
+                       vk::DeviceSize offset,
+                       vk::DeviceSize size,
+                       vk::PipelineStageFlags srcStageMask,
+                       vk::AccessFlags srcAccessMask) const
+    {
+      if (getFamily(source) == getFamily(destination))
+        return;
+      barriers.addBufferBarrier(srcStageMask,
+                                vk::PipelineStageFlagBits::eBottomOfPipe,
+                                {srcAccessMask, {}, getFamily(source), getFamily(destination), buffer, offset, size});
+    }
+
+    /// \brief Records the acquire half of a buffer ownership transfer from `source` to `destination`, in a command buffer of `destination`
+    void acquireBuffer(BarrierBatcher &barriers,
+                       QueueRole source,
+                       QueueRole destination,
+                       vk::Buffer buffer,
+                       vk::DeviceSize offset,
+                       vk::DeviceSize size,
+                       vk::PipelineStageFlags dstStageMask,
+                       vk::AccessFlags dstAccessMask) const
+    {
+      if (getFamily(source) == getFamily(destination))
+        return;
+      barriers.addBufferBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                dstStageMask,
+                                {{}, dstAccessMask, getFamily(source), getFamily(destination), buffer, offset, size});
+    }
+
+    /// \brief Records the release half of an image ownership transfer, which can also change its layout, in a command buffer of `source`
+    void releaseImage(BarrierBatcher &barriers,
+                      QueueRole source,
+                      QueueRole destination,
+                      vk::Image image,
+                      vk::ImageSubresourceRange const &subresourceRange,
+                      vk::ImageLayout oldLayout,
+                      vk::ImageLayout newLayout,
+                      vk::PipelineStageFlags srcStageMask,
+                      vk::AccessFlags srcAccessMask) const
+    {
+      bool const isTransfer(getFamily(source) != getFamily(destination));
+
+      if (!isTransfer && oldLayout == newLayout)
+        return;
+      barriers.addImageBarrier(srcStageMask,
+                               vk::PipelineStageFlagBits::eBottomOfPipe,
+                               {srcAccessMask,
+                                {},
+                                oldLayout,
+                                newLayout,
+                                isTransfer ? getFamily(source) : VK_QUEUE_FAMILY_IGNORED,
+                                isTransfer ? getFamily(destination) : VK_QUEUE_FAMILY_IGNORED,
+                                image,
+                                subresourceRange});
+    }
+
+    /// \brief Records the acquire half of an image ownership transfer, with the same layouts as the release, in a command buffer of `destination`
+    void acquireImage(BarrierBatcher &barriers,
+                      QueueRole source,
+                      QueueRole destination,
+                      vk::Image image,
+                      vk::ImageSubresourceRange const &subresourceRange,
+                      vk::ImageLayout oldLayout,
+                      vk::ImageLayout newLayout,
+                      vk::PipelineStageFlags dstStageMask,
+                      vk::AccessFlags dstAccessMask) const
+    {
+      if (getFamily(source) == getFamily(destination))
+        return;
+      barriers.addImageBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        dstStageMask,
+        {{}, dstAccessMask, oldLayout, newLayout, getFamily(source), getFamily(destination), image, subresourceRange});
+    }
+  };
+};
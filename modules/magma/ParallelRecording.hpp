@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "magma/CommandBuffer.hpp"
+#include "magma/CommandPoolManager.hpp"
+#include "magma/WorkStealingThreadPool.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Records `drawCount` draws over several threads, and executes them from `commandBuffer` in order
+  ///
+  /// The draws are split in chunks of `chunkSize`, each recorded in its own secondary command buffer
+  /// by `record(renderPassCommands, secondaryCommandBuffer, begin, end)`, where `[begin, end)` is the chunk's part of the draw list.
+  /// Secondary command buffers come from the recording thread's pool in `commandPoolManager`,
+  /// and are begun with `eRenderPassContinue` and `inheritanceInfo`, which must describe the current render pass and subpass.
+  /// No state is inherited between chunks, so `record` must bind everything its draws use.
+  ///
+  /// The current subpass of `commandBuffer` must have been begun with `vk::SubpassContents::eSecondaryCommandBuffers`.
+  /// Secondary command buffers are executed in chunk order, so the result doesn't depend on scheduling.
+  ///
+  template<class RecordFunc>
+  void recordParallel(PrimaryCommandBuffer const &commandBuffer,
+                      vk::CommandBufferInheritanceInfo const &inheritanceInfo,
+                      WorkStealingThreadPool &threadPool,
+                      CommandPoolManager &commandPoolManager,
+                      std::size_t drawCount,
+                      std::size_t chunkSize,
+                      RecordFunc &&record)
+  {
+    chunkSize = std::max(chunkSize, std::size_t(1u));
+
+    std::vector<vk::CommandBuffer> secondaryCommandBuffers((drawCount + chunkSize - 1u) / chunkSize);
+
+    threadPool.parallelFor(secondaryCommandBuffers.size(), [&](std::size_t chunk) {
+      SecondaryCommandBuffer secondaryCommandBuffer(commandPoolManager.getSecondaryCommandBuffer());
+
+      secondaryCommandBuffer.begin(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, inheritanceInfo);
+      record(secondaryCommandBuffer.continueRenderPass(), secondaryCommandBuffer, chunk * chunkSize, std::min(drawCount, (chunk + 1u) * chunkSize));
+      secondaryCommandBuffer.end();
+      secondaryCommandBuffers[chunk] = secondaryCommandBuffer.raw();
+    });
+    if (!secondaryCommandBuffers.empty())
+      commandBuffer.execBuffers(secondaryCommandBuffers);
+  }
+};
@@ -120,6 +120,27 @@ namespace magma
     }
   };
 
+  class ComputePipelineConfig : public vk::ComputePipelineCreateInfo
+  {
+  public:
+    ComputePipelineConfig(vk::PipelineCreateFlags flags, vk::PipelineShaderStageCreateInfo const &stage, PipelineLayout<claws::no_delete> const &layout)
+      : vk::ComputePipelineCreateInfo(flags, stage, layout, nullptr, -1)
+    {}
+
+    /// \brief Uses `entryPoint` of `shaderModule` as the compute stage, `entryPoint` must outlive the config
+    ComputePipelineConfig(vk::PipelineCreateFlags flags,
+                          claws::handle<vk::ShaderModule, claws::no_delete> shaderModule,
+                          char const *entryPoint,
+                          PipelineLayout<claws::no_delete> const &layout)
+      : ComputePipelineConfig(flags, vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eCompute, shaderModule, entryPoint}, layout)
+    {}
+
+    void setSpecializationInfo(vk::SpecializationInfo const &specializationInfo)
+    {
+      stage.pSpecializationInfo = &specializationInfo;
+    }
+  };
+
   template<class Deleter = Deleter>
   using Pipeline = claws::handle<vk::Pipeline, Deleter>;
 
@@ -127,4 +148,9 @@ namespace magma
   {
     return Pipeline<>(Deleter{magma::Device<claws::no_delete>(*this)}, vk::Device::createGraphicsPipeline(nullptr, createInfo));
   }
+
+  inline auto impl::Device::createComputePipeline(vk::ComputePipelineCreateInfo const &createInfo) const
+  {
+    return Pipeline<>(Deleter{magma::Device<claws::no_delete>(*this)}, vk::Device::createComputePipeline(nullptr, createInfo));
+  }
 };
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+
+#include "magma/BarrierBatcher.hpp"
+#include "magma/CommandBuffer.hpp"
+#include "magma/DynamicBuffer.hpp"
+#include "magma/QueryPool.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Ends a query when destroyed
+  ///
+  /// `Commands` is either a command buffer or a `RenderPassCommands`, which must outlive the scope.
+  ///
+  template<class Commands>
+  class QueryScope
+  {
+    Commands const *commands;
+    QueryPool<claws::no_delete> queryPool;
+    uint32_t query;
+
+  public:
+    QueryScope(Commands const &commands, QueryPool<claws::no_delete> queryPool, uint32_t query, vk::QueryControlFlags flags)
+      : commands(&commands)
+      , queryPool(queryPool)
+      , query(query)
+    {
+      commands.beginQuery(queryPool, query, flags);
+    }
+
+    QueryScope(QueryScope const &) = delete;
+
+    QueryScope(QueryScope &&other)
+      : commands(other.commands)
+      , queryPool(other.queryPool)
+      , query(other.query)
+    {
+      other.commands = nullptr;
+    }
+
+    QueryScope &operator=(QueryScope const &) = delete;
+    QueryScope &operator=(QueryScope &&) = delete;
+
+    ~QueryScope()
+    {
+      if (commands)
+        commands->endQuery(queryPool, query);
+    }
+  };
+
+  ///
+  /// \brief A pool of occlusion queries, counting the samples that pass the depth and stencil tests between their begin and end
+  ///
+  /// Results can be read back on the host, or copied to a buffer on the GPU, where they can drive conditional rendering
+  /// (see `RenderPassCommands::beginConditionalRendering`) without a round trip through the CPU.
+  ///
+  class OcclusionQueries
+  {
+    Device<claws::no_delete> device;
+    QueryPool<> queryPool;
+    uint32_t queryCount;
+
+  public:
+    OcclusionQueries(Device<claws::no_delete> device, uint32_t queryCount)
+      : device(device)
+      , queryPool(device.createQueryPool(vk::QueryType::eOcclusion, queryCount))
+      , queryCount(queryCount)
+    {}
+
+    OcclusionQueries(OcclusionQueries const &) = delete;
+    OcclusionQueries(OcclusionQueries &&) = default;
+
+    OcclusionQueries &operator=(OcclusionQueries const &) = delete;
+    OcclusionQueries &operator=(OcclusionQueries &&) = default;
+
+    /// \brief Resets every query, outside of any render pass, before they are used again
+    void reset(CommandBuffer const &commandBuffer) const
+    {
+      commandBuffer.resetQueryPool(queryPool, 0u, queryCount);
+    }
+
+    /// \brief Begins a query, which ends when the returned scope is destroyed. `precise` requires the `occlusionQueryPrecise` feature
+    template<class Commands>
+    auto query(Commands const &commands, uint32_t query, bool precise = false) const
+    {
+      return QueryScope<Commands>(commands, queryPool, query, precise ? vk::QueryControlFlagBits::ePrecise : vk::QueryControlFlags{});
+    }
+
+    ///
+    /// \brief Copies every result to `range`, as `uint32_t`, outside of any render pass
+    ///
+    /// The copy waits on the GPU for the results, and is made visible to conditional rendering.
+    /// `buffer` must be created with `vk::BufferUsageFlagBits::eTransferDst` and `eConditionalRenderingEXT`,
+    /// and the range must not be read by conditional rendering while it is written, e.g. by keeping one per frame in flight.
+    ///
+    void copyResults(CommandBuffer &commandBuffer, DynamicBuffer &buffer, DynamicBuffer::RangeId range) const
+    {
+      BarrierBatcher barriers;
+
+      commandBuffer.copyQueryPoolResults(
+        queryPool, 0u, queryCount, buffer.getBuffer(range), range.second, sizeof(uint32_t), vk::QueryResultFlagBits::eWait);
+      barriers.addBufferBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eConditionalRenderingEXT,
+                                {vk::AccessFlagBits::eTransferWrite,
+                                 vk::AccessFlagBits::eConditionalRenderingReadEXT,
+                                 VK_QUEUE_FAMILY_IGNORED,
+                                 VK_QUEUE_FAMILY_IGNORED,
+                                 buffer.getBuffer(range),
+                                 range.second,
+                                 sizeof(uint32_t) * queryCount});
+      barriers.flush(commandBuffer.raw());
+    }
+
+    /// \brief Reads every result back on the host, returns `false` without waiting if they are not all available yet
+    bool getResults(std::vector<uint64_t> &results) const
+    {
+      results.resize(queryCount);
+      return device.getQueryPoolResults(
+               queryPool, 0u, queryCount, results.size() * sizeof(uint64_t), results.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64)
+             == vk::Result::eSuccess;
+    }
+
+    QueryPool<claws::no_delete> getQueryPool() const noexcept
+    {
+      return queryPool;
+    }
+  };
+
+  ///
+  /// \brief A pool of pipeline statistics queries, counting e.g. vertices, primitives or shader invocations between their begin and end
+  ///
+  /// Requires the `pipelineStatisticsQuery` feature. Pipeline statistics queries can only be begun in primary command buffers.
+  ///
+  class PipelineStatisticsQueries
+  {
+    Device<claws::no_delete> device;
+    QueryPool<> queryPool;
+    uint32_t queryCount;
+    uint32_t statisticCount;
+
+  public:
+    PipelineStatisticsQueries(Device<claws::no_delete> device, vk::QueryPipelineStatisticFlags statistics, uint32_t queryCount)
+      : device(device)
+      , queryPool(device.createQueryPool(vk::QueryType::ePipelineStatistics, queryCount, statistics))
+      , queryCount(queryCount)
+      , statisticCount(0u)
+    {
+      for (auto bits(static_cast<VkQueryPipelineStatisticFlags>(statistics)); bits; bits &= bits - 1u)
+        ++statisticCount;
+    }
+
+    PipelineStatisticsQueries(PipelineStatisticsQueries const &) = delete;
+    PipelineStatisticsQueries(PipelineStatisticsQueries &&) = default;
+
+    PipelineStatisticsQueries &operator=(PipelineStatisticsQueries const &) = delete;
+    PipelineStatisticsQueries &operator=(PipelineStatisticsQueries &&) = default;
+
+    /// \brief Resets every query, outside of any render pass, before they are used again
+    void reset(CommandBuffer const &commandBuffer) const
+    {
+      commandBuffer.resetQueryPool(queryPool, 0u, queryCount);
+    }
+
+    /// \brief Begins a query, which ends when the returned scope is destroyed
+    auto query(PrimaryCommandBuffer const &commandBuffer, uint32_t query) const
+    {
+      return QueryScope<PrimaryCommandBuffer>(commandBuffer, queryPool, query, {});
+    }
+
+    ///
+    /// \brief Reads every result back on the host, returns `false` without waiting if they are not all available yet
+    ///
+    /// Results are stored query by query, each with `getStatisticCount` values in the order of the `vk::QueryPipelineStatisticFlagBits`.
+    ///
+    bool getResults(std::vector<uint64_t> &results) const
+    {
+      results.resize(queryCount * statisticCount);
+      return device.getQueryPoolResults(queryPool,
+                                        0u,
+                                        queryCount,
+                                        results.size() * sizeof(uint64_t),
+                                        results.data(),
+                                        statisticCount * sizeof(uint64_t),
+                                        vk::QueryResultFlagBits::e64)
+             == vk::Result::eSuccess;
+    }
+
+    uint32_t getStatisticCount() const noexcept
+    {
+      return statisticCount;
+    }
+  };
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "magma/Deleter.hpp"
+#include "magma/Device.hpp"
+
+namespace magma
+{
+  template<class Deleter = Deleter>
+  using QueryPool = claws::handle<vk::QueryPool, Deleter>;
+
+  inline auto impl::Device::createQueryPool(vk::QueryType queryType, uint32_t queryCount, vk::QueryPipelineStatisticFlags pipelineStatistics) const
+  {
+    return QueryPool<>(Deleter{magma::Device<claws::no_delete>(*this)},
+                       vk::Device::createQueryPool({{}, queryType, queryCount, pipelineStatistics}));
+  }
+};
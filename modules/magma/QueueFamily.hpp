@@ -0,0 +1,19 @@
+#pragma once
+
+#include <optional>
+
+#include "vulkan/vulkan.hpp"
+
+namespace magma
+{
+  /// \brief Returns a queue family that supports every flag of `required`, and none of `excluded`, if there is one
+  inline std::optional<uint32_t> findQueueFamily(vk::PhysicalDevice physicalDevice, vk::QueueFlags required, vk::QueueFlags excluded)
+  {
+    auto const queueFamilyProperties(physicalDevice.getQueueFamilyProperties());
+
+    for (uint32_t i(0u); i < queueFamilyProperties.size(); ++i)
+      if ((queueFamilyProperties[i].queueFlags & required) == required && !(queueFamilyProperties[i].queueFlags & excluded))
+        return i;
+    return std::nullopt;
+  }
+};
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "magma/Buffer.hpp"
+#include "magma/DeviceMemory.hpp"
+#include "magma/Fence.hpp"
+#include "magma/TlsfAllocator.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief One large sparse buffer, whose pages are backed by memory only while ranges use them
+  ///
+  /// Ranges are offsets in a single buffer, so their device addresses never change, and the buffer can span far more memory than is resident.
+  /// Pages are committed when a range first touches them and decommitted when the last range touching them is freed,
+  /// but binding only happens on the device's queue when `bind` is called, which must be done before the new ranges are used.
+  /// Page memory comes from blocks of several pages, to stay well below `maxMemoryAllocationCount`.
+  ///
+  /// The device must be created with the `sparseBinding` and `sparseResidencyBuffer` features,
+  /// and `bind` needs a queue whose family supports `vk::QueueFlagBits::eSparseBinding`.
+  /// Sparse memory can't be mapped, content is written with transfers, e.g. through an `UploadManager`.
+  ///
+  class SparseDynamicBuffer
+  {
+    struct PageMemory
+    {
+      uint32_t block;
+      uint32_t slot;
+    };
+
+    struct Page
+    {
+      uint32_t useCount;
+      PageMemory memory;
+      bool isBound;
+    };
+
+    struct MemoryBlock
+    {
+      DeviceMemory<> deviceMemory;
+      std::vector<uint32_t> freeSlots;
+    };
+
+    struct Retirement
+    {
+      Fence<> fence;
+      std::vector<PageMemory> slots;
+    };
+
+    static constexpr vk::DeviceSize blockSize{vk::DeviceSize(32u) << 20u};
+
+    Device<claws::no_delete> device;
+    Buffer<> buffer;
+    vk::DeviceSize pageSize;
+    uint32_t memoryTypeIndex;
+    uint32_t pagesPerBlock;
+    TlsfAllocator<vk::DeviceSize> allocator;
+    std::unordered_map<vk::DeviceSize, Page> pages;
+    std::vector<vk::DeviceSize> committedPages;
+    std::vector<vk::DeviceSize> unusedPages;
+    std::vector<MemoryBlock> blocks;
+    std::deque<Retirement> retirements;
+
+    PageMemory allocatePageMemory()
+    {
+      for (uint32_t i(0u); i < blocks.size(); ++i)
+        if (!blocks[i].freeSlots.empty())
+          {
+            uint32_t const slot(blocks[i].freeSlots.back());
+
+            blocks[i].freeSlots.pop_back();
+            return {i, slot};
+          }
+
+      uint32_t const index(
+        static_cast<uint32_t>(std::find_if(blocks.begin(), blocks.end(), [](auto const &block) { return !block.deviceMemory; }) - blocks.begin()));
+
+      if (index == blocks.size())
+        blocks.emplace_back();
+
+      MemoryBlock &block(blocks[index]);
+
+      block.deviceMemory = device.createDeviceMemory(pageSize * pagesPerBlock, memoryTypeIndex);
+      for (uint32_t slot(pagesPerBlock - 1u); slot; --slot)
+        block.freeSlots.push_back(slot);
+      return {index, 0u};
+    }
+
+    void freePageMemory(PageMemory memory)
+    {
+      MemoryBlock &block(blocks[memory.block]);
+
+      block.freeSlots.push_back(memory.slot);
+      if (block.freeSlots.size() == pagesPerBlock)
+        block = MemoryBlock{};
+    }
+
+    void commitPage(vk::DeviceSize index)
+    {
+      auto it(pages.find(index));
+
+      if (it == pages.end())
+        {
+          it = pages.emplace(index, Page{0u, allocatePageMemory(), false}).first;
+          committedPages.push_back(index);
+        }
+      ++it->second.useCount;
+    }
+
+    void releasePage(vk::DeviceSize index)
+    {
+      if (!--pages.at(index).useCount)
+        unusedPages.push_back(index);
+    }
+
+    static Buffer<> createSparseBuffer(Device<claws::no_delete> device,
+                                       vk::BufferUsageFlags usage,
+                                       vk::DeviceSize size,
+                                       std::optional<std::vector<uint32_t>> const &queueFamilies)
+    {
+      vk::BufferCreateFlags const flags(vk::BufferCreateFlagBits::eSparseBinding | vk::BufferCreateFlagBits::eSparseResidency);
+
+      return queueFamilies ? device.createBuffer(flags, size, usage, *queueFamilies) : device.createBuffer(flags, size, usage);
+    }
+
+  public:
+    ///
+    /// \brief Creates a sparse buffer of `virtualSize` bytes, without any memory
+    ///
+    /// `virtualSize` is rounded up to a whole number of pages, and can't exceed the `sparseAddressSpaceSize` limit.
+    ///
+    SparseDynamicBuffer(Device<claws::no_delete> device,
+                        vk::PhysicalDevice physicalDevice,
+                        vk::BufferUsageFlags usage,
+                        vk::MemoryPropertyFlags memoryFlags,
+                        vk::DeviceSize virtualSize,
+                        std::optional<std::vector<uint32_t>> &&queueFamilies = {})
+      : device(device)
+      , buffer(createSparseBuffer(device, usage, virtualSize, queueFamilies))
+      , allocator(virtualSize)
+    {
+      auto memRequirements(device.getBufferMemoryRequirements(buffer));
+
+      // sparse buffers report their page size as their alignment, which doesn't depend on their size
+      pageSize = memRequirements.alignment;
+      if (virtualSize % pageSize)
+        {
+          // the last page would otherwise only be partially bindable
+          virtualSize += pageSize - virtualSize % pageSize;
+          buffer = createSparseBuffer(device, usage, virtualSize, queueFamilies);
+          allocator = TlsfAllocator<vk::DeviceSize>(virtualSize);
+          memRequirements = device.getBufferMemoryRequirements(buffer);
+        }
+      pagesPerBlock = static_cast<uint32_t>(std::max(vk::DeviceSize(1u), blockSize / pageSize));
+      memoryTypeIndex = selectDeviceMemoryType(physicalDevice, pageSize * pagesPerBlock, memoryFlags, memRequirements.memoryTypeBits);
+    }
+
+    SparseDynamicBuffer(SparseDynamicBuffer const &) = delete;
+    SparseDynamicBuffer(SparseDynamicBuffer &&) = default;
+
+    SparseDynamicBuffer &operator=(SparseDynamicBuffer const &) = delete;
+    SparseDynamicBuffer &operator=(SparseDynamicBuffer &&) = delete;
+
+    ~SparseDynamicBuffer()
+    {
+      for (auto const &retirement : retirements)
+        {
+          vk::Fence const fence(retirement.fence);
+
+          device.waitForFences({fence}, true, ~0ull);
+        }
+    }
+
+    ///
+    /// \brief Allocates a range whose offset is a multiple of `alignment`, committing the pages it touches
+    ///
+    /// Throws `std::runtime_error` when the buffer's address space is exhausted.
+    /// @return the offset of the range in the buffer.
+    ///
+    vk::DeviceSize allocate(vk::DeviceSize size, vk::DeviceSize alignment = 1u)
+    {
+      auto const offset(allocator.allocate(size, alignment));
+
+      if (!offset)
+        throw std::runtime_error("Sparse buffer address space is exhausted");
+
+      vk::DeviceSize const firstPage(*offset / pageSize);
+      vk::DeviceSize const endPage((*offset + allocator.getSize(*offset) + pageSize - 1u) / pageSize);
+      vk::DeviceSize page(firstPage);
+
+      try
+        {
+          for (; page < endPage; ++page)
+            commitPage(page);
+        }
+      catch (...)
+        {
+          while (page-- > firstPage)
+            releasePage(page);
+          allocator.deallocate(*offset);
+          throw;
+        }
+      return *offset;
+    }
+
+    /// \brief Frees a range, the pages no other range touches are decommitted by the next `bind`
+    void free(vk::DeviceSize offset)
+    {
+      vk::DeviceSize const size(allocator.deallocate(offset));
+
+      for (vk::DeviceSize page(offset / pageSize); page < (offset + size + pageSize - 1u) / pageSize; ++page)
+        releasePage(page);
+    }
+
+    ///
+    /// \brief Binds the pages committed, and unbinds the pages decommitted, since the last call, with a single `bindSparse`
+    ///
+    /// Ranges allocated before the call can be used by work waiting on `signalSemaphores`.
+    /// Memory of decommitted pages is only reused once the binding has completed, see `update`.
+    ///
+    void bind(vk::Queue queue, vk::ArrayProxy<vk::Semaphore const> waitSemaphores = nullptr, vk::ArrayProxy<vk::Semaphore const> signalSemaphores = nullptr)
+    {
+      std::vector<vk::SparseMemoryBind> binds;
+      std::vector<PageMemory> retiredSlots;
+
+      for (auto index : unusedPages)
+        {
+          auto it(pages.find(index));
+
+          // the page may have been used again, or already released by a previous entry
+          if (it == pages.end() || it->second.useCount)
+            continue;
+          if (it->second.isBound)
+            {
+              binds.push_back({index * pageSize, pageSize, nullptr, 0u, {}});
+              retiredSlots.push_back(it->second.memory);
+            }
+          else
+            freePageMemory(it->second.memory);
+          pages.erase(it);
+        }
+      unusedPages.clear();
+      for (auto index : committedPages)
+        {
+          auto it(pages.find(index));
+
+          if (it == pages.end() || it->second.isBound)
+            continue;
+          binds.push_back({index * pageSize, pageSize, blocks[it->second.memory.block].deviceMemory, it->second.memory.slot * pageSize, {}});
+          it->second.isBound = true;
+        }
+      committedPages.clear();
+      if (binds.empty() && waitSemaphores.empty() && signalSemaphores.empty())
+        return;
+
+      vk::SparseBufferMemoryBindInfo const bufferBind{buffer, static_cast<uint32_t>(binds.size()), binds.data()};
+      vk::BindSparseInfo const bindInfo{waitSemaphores.size(),
+                                        waitSemaphores.data(),
+                                        binds.empty() ? 0u : 1u,
+                                        &bufferBind,
+                                        0,
+                                        nullptr,
+                                        0,
+                                        nullptr,
+                                        signalSemaphores.size(),
+                                        signalSemaphores.data()};
+      auto fence(device.createFence({}));
+
+      queue.bindSparse({bindInfo}, fence);
+      retirements.push_back({std::move(fence), std::move(retiredSlots)});
+    }
+
+    /// \brief Recycles the memory of pages whose unbinding has completed, releasing blocks that end up unused
+    void update()
+    {
+      while (!retirements.empty() && device.getFenceStatus(retirements.front().fence) == vk::Result::eSuccess)
+        {
+          for (auto const &slot : retirements.front().slots)
+            freePageMemory(slot);
+          retirements.pop_front();
+        }
+    }
+
+    vk::DeviceSize getPageSize() const noexcept
+    {
+      return pageSize;
+    }
+
+    /// \brief Returns the size of the committed pages, including those waiting to be unbound
+    vk::DeviceSize getResidentSize() const noexcept
+    {
+      return pages.size() * pageSize;
+    }
+
+    vk::DeviceSize getAllocatedSize() const noexcept
+    {
+      return allocator.getAllocatedSize();
+    }
+
+    magma::Buffer<claws::no_delete> getBuffer()
+    {
+      return buffer;
+    }
+  };
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include "vulkan/vulkan.hpp"
+
+#include "magma/Buffer.hpp"
+#include "magma/Pipeline.hpp"
+#include "magma/PipelineLayout.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Records binding commands on a command buffer, dropping the ones that wouldn't change the bound state
+  ///
+  /// Remembers the bound pipelines, vertex and index buffers, descriptor sets and push constant bytes,
+  /// and only forwards what differs: a `bindVertexBuffers` call is trimmed to the bindings that actually change.
+  /// Every dropped command is counted, see `getElidedCount`.
+  ///
+  /// The tracker assumes it sees every binding command recorded on the command buffer.
+  /// State that is disturbed behind its back (e.g. by `executeCommands`, or when a new command buffer begins) must be forgotten with `invalidate`.
+  ///
+  class StateTracker
+  {
+    struct DescriptorSetBinding
+    {
+      vk::DescriptorSet descriptorSet;
+      std::vector<uint32_t> dynamicOffsets;
+    };
+
+    struct BindPointState
+    {
+      vk::Pipeline pipeline;
+      vk::PipelineLayout descriptorSetLayout;
+      std::vector<DescriptorSetBinding> descriptorSets;
+    };
+
+    vk::CommandBuffer commandBuffer;
+    std::array<BindPointState, 2> bindPoints;
+    std::vector<std::pair<vk::Buffer, vk::DeviceSize>> vertexBuffers;
+    vk::Buffer indexBuffer;
+    vk::DeviceSize indexOffset;
+    vk::IndexType indexType;
+    vk::PipelineLayout pushConstantLayout;
+    std::vector<char> pushConstantBytes;
+    std::vector<vk::ShaderStageFlags> pushConstantStages;
+    std::size_t elidedCount;
+
+    static std::size_t getBindPointIndex(vk::PipelineBindPoint bindPoint) noexcept
+    {
+      return bindPoint == vk::PipelineBindPoint::eCompute;
+    }
+
+  public:
+    StateTracker(vk::CommandBuffer commandBuffer)
+      : commandBuffer(commandBuffer)
+      , bindPoints{}
+      , vertexBuffers()
+      , indexBuffer(nullptr)
+      , indexOffset(0u)
+      , indexType(vk::IndexType::eUint16)
+      , pushConstantLayout(nullptr)
+      , elidedCount(0u)
+    {}
+
+    /// \brief Forgets the bound state, so that the next binding commands are all recorded
+    void invalidate()
+    {
+      bindPoints = {};
+      vertexBuffers.clear();
+      indexBuffer = nullptr;
+      pushConstantLayout = nullptr;
+      pushConstantBytes.clear();
+      pushConstantStages.clear();
+    }
+
+    void bindPipeline(vk::PipelineBindPoint bindPoint, Pipeline<claws::no_delete> pipeline)
+    {
+      vk::Pipeline &bound(bindPoints[getBindPointIndex(bindPoint)].pipeline);
+
+      if (bound == vk::Pipeline(pipeline))
+        {
+          ++elidedCount;
+          return;
+        }
+      commandBuffer.bindPipeline(bindPoint, pipeline);
+      bound = pipeline;
+    }
+
+    void bindGraphicsPipeline(Pipeline<claws::no_delete> pipeline)
+    {
+      bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+    }
+
+    ///
+    /// \brief Binds descriptor sets, skipping the call if every set is already bound with the same dynamic offsets
+    ///
+    /// `dynamicOffsetCounts` tells how many of `dynamicOffsets` belong to each set, when omitted they all belong to the last set.
+    /// A call with another pipeline layout is always recorded, and forgets the sets bound with the previous one.
+    ///
+    void bindDescriptorSets(vk::PipelineBindPoint bindPoint,
+                            claws::handle<vk::PipelineLayout, claws::no_delete> layout,
+                            uint32_t firstSet,
+                            std::vector<vk::DescriptorSet> const &descriptorSets,
+                            std::vector<uint32_t> const &dynamicOffsets = {},
+                            std::vector<uint32_t> const &dynamicOffsetCounts = {})
+    {
+      BindPointState &state(bindPoints[getBindPointIndex(bindPoint)]);
+      bool changed(state.descriptorSetLayout != vk::PipelineLayout(layout));
+
+      if (changed)
+        {
+          state.descriptorSetLayout = layout;
+          state.descriptorSets.clear();
+        }
+      if (state.descriptorSets.size() < firstSet + descriptorSets.size())
+        {
+          changed = true;
+          state.descriptorSets.resize(firstSet + descriptorSets.size());
+        }
+
+      auto offset(dynamicOffsets.begin());
+
+      for (uint32_t i(0u); i < descriptorSets.size(); ++i)
+        {
+          DescriptorSetBinding &binding(state.descriptorSets[firstSet + i]);
+          auto const offsetEnd(i < dynamicOffsetCounts.size()       ? offset + dynamicOffsetCounts[i]
+                               : i + 1u == descriptorSets.size() ? dynamicOffsets.end()
+                                                                 : offset);
+
+          if (binding.descriptorSet != descriptorSets[i] || !std::equal(offset, offsetEnd, binding.dynamicOffsets.begin(), binding.dynamicOffsets.end()))
+            {
+              changed = true;
+              binding.descriptorSet = descriptorSets[i];
+              binding.dynamicOffsets.assign(offset, offsetEnd);
+            }
+          offset = offsetEnd;
+        }
+      if (!changed)
+        {
+          ++elidedCount;
+          return;
+        }
+      commandBuffer.bindDescriptorSets(bindPoint, layout, firstSet, descriptorSets, dynamicOffsets);
+    }
+
+    /// \brief Binds vertex buffers, only recording the range of bindings that changed
+    void bindVertexBuffers(uint32_t firstBinding, std::vector<vk::Buffer> const &buffers, std::vector<vk::DeviceSize> const &offsets)
+    {
+      if (vertexBuffers.size() < firstBinding + buffers.size())
+        vertexBuffers.resize(firstBinding + buffers.size());
+
+      uint32_t first(static_cast<uint32_t>(buffers.size()));
+      uint32_t last(0u);
+
+      for (uint32_t i(0u); i < buffers.size(); ++i)
+        {
+          auto &bound(vertexBuffers[firstBinding + i]);
+
+          if (bound.first == buffers[i] && bound.second == offsets[i])
+            continue;
+          bound = {buffers[i], offsets[i]};
+          first = std::min(first, i);
+          last = i + 1u;
+        }
+      if (first >= last)
+        {
+          ++elidedCount;
+          return;
+        }
+      commandBuffer.bindVertexBuffers(firstBinding + first, last - first, buffers.data() + first, offsets.data() + first);
+    }
+
+    void bindIndexBuffer(Buffer<claws::no_delete> buffer, vk::DeviceSize offset, vk::IndexType type)
+    {
+      if (indexBuffer == vk::Buffer(buffer) && indexOffset == offset && indexType == type)
+        {
+          ++elidedCount;
+          return;
+        }
+      commandBuffer.bindIndexBuffer(buffer, offset, type);
+      indexBuffer = buffer;
+      indexOffset = offset;
+      indexType = type;
+    }
+
+    /// \brief Pushes constants, skipping the call if the same bytes were already pushed to the same stages with the same layout
+    void pushConstants(claws::handle<vk::PipelineLayout, claws::no_delete> layout,
+                       vk::ShaderStageFlags shaderStages,
+                       uint32_t offset,
+                       uint32_t size,
+                       void const *data)
+    {
+      if (pushConstantLayout != vk::PipelineLayout(layout))
+        {
+          pushConstantLayout = layout;
+          pushConstantBytes.clear();
+          pushConstantStages.clear();
+        }
+      if (pushConstantBytes.size() < offset + size)
+        {
+          pushConstantBytes.resize(offset + size);
+          pushConstantStages.resize(offset + size);
+        }
+      if (std::all_of(pushConstantStages.begin() + offset, pushConstantStages.begin() + offset + size, [shaderStages](auto stages) { return stages == shaderStages; })
+          && !std::memcmp(pushConstantBytes.data() + offset, data, size))
+        {
+          ++elidedCount;
+          return;
+        }
+      commandBuffer.pushConstants(layout, shaderStages, offset, size, data);
+      std::memcpy(pushConstantBytes.data() + offset, data, size);
+      std::fill(pushConstantStages.begin() + offset, pushConstantStages.begin() + offset + size, shaderStages);
+    }
+
+    template<class Container>
+    void pushConstants(claws::handle<vk::PipelineLayout, claws::no_delete> layout,
+                       vk::ShaderStageFlags shaderStages,
+                       uint32_t elemOffset,
+                       Container const &data)
+    {
+      constexpr uint32_t elemSize(sizeof(decltype(*data.data())));
+      pushConstants(layout, shaderStages, elemOffset * elemSize, static_cast<uint32_t>(elemSize * data.size()), data.data());
+    }
+
+    /// \brief Returns how many commands were dropped since the tracker was created or the count was reset
+    std::size_t getElidedCount() const noexcept
+    {
+      return elidedCount;
+    }
+
+    void resetElidedCount() noexcept
+    {
+      elidedCount = 0u;
+    }
+  };
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "magma/CommandBuffer.hpp"
+#include "magma/Fence.hpp"
+#include "magma/Semaphore.hpp"
+#include "magma/TimelineSemaphore.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Accumulates command buffers with their semaphores, and submits them to a queue in a single `vkQueueSubmit`
+  ///
+  /// Submissions are kept in the order they were enqueued, and merged into the fewest `vk::SubmitInfo` that keep their semantics:
+  /// a submission joins the previous batch if that batch doesn't signal anything yet, and if it doesn't wait on anything,
+  /// or the batch doesn't contain command buffers yet.
+  ///
+  /// Timeline semaphores (see `TimelineSemaphore`) are waited on and signaled with values, through `vk::TimelineSemaphoreSubmitInfo`.
+  ///
+  /// Enqueuing and flushing are thread-safe.
+  /// The queue is externally synchronized: nothing else may submit to it while `flush` runs.
+  ///
+  class SubmissionBatcher
+  {
+    struct Batch
+    {
+      std::vector<vk::Semaphore> waitSemaphores;
+      std::vector<vk::PipelineStageFlags> waitStages;
+      std::vector<uint64_t> waitValues;
+      std::vector<vk::CommandBuffer> commandBuffers;
+      std::vector<vk::Semaphore> signalSemaphores;
+      std::vector<uint64_t> signalValues;
+      bool hasTimelineSemaphores;
+    };
+
+    vk::Queue queue;
+    std::vector<Batch> batches;
+    std::mutex mutex;
+
+  public:
+    SubmissionBatcher(vk::Queue queue)
+      : queue(queue)
+    {}
+
+    SubmissionBatcher(SubmissionBatcher const &) = delete;
+    SubmissionBatcher(SubmissionBatcher &&) = delete;
+
+    SubmissionBatcher &operator=(SubmissionBatcher const &) = delete;
+    SubmissionBatcher &operator=(SubmissionBatcher &&) = delete;
+
+    ///
+    /// \brief Queues command buffers for the next flush
+    ///
+    /// They execute once every semaphore of `waitSemaphores` is signaled, or has reached its value for timeline semaphores, each waited on at its stage.
+    /// `signalSemaphores` are signaled, or set to their value for timeline semaphores, once they complete.
+    /// Values are ignored for binary semaphores. Batches with any timeline semaphore are submitted with a `vk::TimelineSemaphoreSubmitInfo`.
+    ///
+    void enqueue(std::vector<vk::CommandBuffer> const &commandBuffers,
+                 std::vector<SemaphoreWait> const &waitSemaphores,
+                 std::vector<SemaphoreSignal> const &signalSemaphores)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (batches.empty() || !batches.back().signalSemaphores.empty()
+          || (!waitSemaphores.empty() && !batches.back().commandBuffers.empty()))
+        batches.push_back({{}, {}, {}, {}, {}, {}, false});
+
+      Batch &batch(batches.back());
+
+      for (auto const &wait : waitSemaphores)
+        {
+          batch.waitSemaphores.push_back(wait.semaphore);
+          batch.waitStages.push_back(wait.stages);
+          batch.waitValues.push_back(wait.value);
+          batch.hasTimelineSemaphores |= wait.isTimeline;
+        }
+      batch.commandBuffers.insert(batch.commandBuffers.end(), commandBuffers.begin(), commandBuffers.end());
+      for (auto const &signal : signalSemaphores)
+        {
+          batch.signalSemaphores.push_back(signal.semaphore);
+          batch.signalValues.push_back(signal.value);
+          batch.hasTimelineSemaphores |= signal.isTimeline;
+        }
+    }
+
+    /// \brief Same as the other `enqueue`, with binary semaphores only
+    void enqueue(std::vector<vk::CommandBuffer> const &commandBuffers,
+                 std::vector<std::pair<Semaphore<claws::no_delete>, vk::PipelineStageFlags>> const &waitSemaphores = {},
+                 std::vector<Semaphore<claws::no_delete>> const &signalSemaphores = {})
+    {
+      std::vector<SemaphoreWait> waits;
+      std::vector<SemaphoreSignal> signals;
+
+      for (auto const &[semaphore, stages] : waitSemaphores)
+        waits.push_back({semaphore, stages, 0u, false});
+      for (auto const &semaphore : signalSemaphores)
+        signals.push_back({semaphore, 0u, false});
+      enqueue(commandBuffers, waits, signals);
+    }
+
+    void enqueue(PrimaryCommandBuffer &commandBuffer,
+                 std::vector<std::pair<Semaphore<claws::no_delete>, vk::PipelineStageFlags>> const &waitSemaphores = {},
+                 std::vector<Semaphore<claws::no_delete>> const &signalSemaphores = {})
+    {
+      enqueue(std::vector<vk::CommandBuffer>{commandBuffer.raw()}, waitSemaphores, signalSemaphores);
+    }
+
+    ///
+    /// \brief Submits everything enqueued so far, signaling `fence` once it all completes
+    ///
+    /// The fence is signaled even when nothing was enqueued.
+    ///
+    void flush(Fence<claws::no_delete> fence = {})
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      vk::Fence const rawFence(fence);
+      std::vector<vk::SubmitInfo> submitInfos;
+      std::vector<vk::TimelineSemaphoreSubmitInfo> timelineInfos;
+
+      submitInfos.reserve(batches.size());
+      timelineInfos.reserve(batches.size());
+      for (auto const &batch : batches)
+        {
+          submitInfos.push_back({static_cast<uint32_t>(batch.waitSemaphores.size()),
+                                 batch.waitSemaphores.data(),
+                                 batch.waitStages.data(),
+                                 static_cast<uint32_t>(batch.commandBuffers.size()),
+                                 batch.commandBuffers.data(),
+                                 static_cast<uint32_t>(batch.signalSemaphores.size()),
+                                 batch.signalSemaphores.data()});
+          if (batch.hasTimelineSemaphores)
+            {
+              timelineInfos.push_back({static_cast<uint32_t>(batch.waitValues.size()),
+                                       batch.waitValues.data(),
+                                       static_cast<uint32_t>(batch.signalValues.size()),
+                                       batch.signalValues.data()});
+              submitInfos.back().pNext = &timelineInfos.back();
+            }
+        }
+      if (!submitInfos.empty() || rawFence)
+        queue.submit(submitInfos, rawFence);
+      batches.clear();
+    }
+
+    /// \brief Returns how many `vk::SubmitInfo` the next flush would submit
+    std::size_t getBatchCount()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      return batches.size();
+    }
+  };
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace magma
+{
+  namespace impl
+  {
+    ///
+    /// \brief Gives each thread its own `Value`, separately for every instance, e.g. a cache or a command pool per thread
+    ///
+    /// Values are created on a thread's first `get`, owned by the `ThreadLocal`, and destroyed along with it.
+    /// Each thread finds its values through a `thread_local` map, without locking.
+    /// Entries of destroyed instances are dropped whenever the thread registers with a new instance,
+    /// so a thread's map only holds as many entries as there are live instances it used.
+    ///
+    /// If `onThreadExit` is given, it is called from a thread that exits while the instance is alive, with that thread's value,
+    /// which is then destroyed. Otherwise values outlive their thread, until the instance is destroyed.
+    ///
+    template<class Value>
+    class ThreadLocal
+    {
+      struct Shared
+      {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Value>> values;
+        std::function<void(Value &)> onThreadExit;
+      };
+
+      struct ThreadEntry
+      {
+        std::weak_ptr<Shared> shared;
+        Value *value;
+      };
+
+      struct ThreadEntries
+      {
+        std::unordered_map<uint64_t, ThreadEntry> entries;
+
+        ~ThreadEntries()
+        {
+          for (auto const &entry : entries)
+            if (auto const shared = entry.second.shared.lock())
+              {
+                Value *const value(entry.second.value);
+                std::lock_guard<std::mutex> lock(shared->mutex);
+
+                if (!shared->onThreadExit)
+                  continue;
+                shared->onThreadExit(*value);
+                shared->values.erase(
+                  std::find_if(shared->values.begin(), shared->values.end(), [value](auto const &ownedValue) { return ownedValue.get() == value; }));
+              }
+        }
+      };
+
+      uint64_t instanceId;
+      std::shared_ptr<Shared> shared;
+
+      static uint64_t getNextInstanceId() noexcept
+      {
+        static std::atomic<uint64_t> nextInstanceId(0u);
+
+        return nextInstanceId++;
+      }
+
+      static auto &getThreadEntries() noexcept
+      {
+        thread_local ThreadEntries threadEntries;
+
+        return threadEntries.entries;
+      }
+
+    public:
+      ThreadLocal(std::function<void(Value &)> onThreadExit = nullptr)
+        : instanceId(getNextInstanceId())
+        , shared(std::make_shared<Shared>())
+      {
+        shared->onThreadExit = std::move(onThreadExit);
+      }
+
+      ThreadLocal(ThreadLocal const &) = delete;
+      ThreadLocal(ThreadLocal &&) = delete;
+
+      ThreadLocal &operator=(ThreadLocal const &) = delete;
+      ThreadLocal &operator=(ThreadLocal &&) = delete;
+
+      /// waits for exiting threads that are still handing their value to `onThreadExit`
+      ~ThreadLocal()
+      {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+
+        shared->onThreadExit = nullptr;
+      }
+
+      /// \brief Returns the calling thread's value, default constructing it on first use
+      Value &get()
+      {
+        auto &threadEntries(getThreadEntries());
+        auto const it(threadEntries.find(instanceId));
+
+        if (it != threadEntries.end())
+          return *it->second.value;
+        for (auto entry(threadEntries.begin()); entry != threadEntries.end();)
+          if (entry->second.shared.expired())
+            entry = threadEntries.erase(entry);
+          else
+            ++entry;
+
+        std::lock_guard<std::mutex> lock(shared->mutex);
+
+        shared->values.push_back(std::make_unique<Value>());
+        threadEntries.emplace(instanceId, ThreadEntry{shared, shared->values.back().get()});
+        return *shared->values.back();
+      }
+    };
+  }
+};
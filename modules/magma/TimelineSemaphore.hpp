@@ -0,0 +1,92 @@
+#pragma once
+
+#include "magma/Semaphore.hpp"
+
+namespace magma
+{
+  inline auto impl::Device::createTimelineSemaphore(uint64_t initialValue) const
+  {
+    vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> const createInfo{{}, {vk::SemaphoreType::eTimeline, initialValue}};
+
+    return Semaphore<>(Deleter{magma::Device<claws::no_delete>(*this)}, vk::Device::createSemaphore(createInfo.get<vk::SemaphoreCreateInfo>()));
+  }
+
+  /// \brief A semaphore to wait on in a submission, with the value to wait for if it is a timeline semaphore
+  struct SemaphoreWait
+  {
+    vk::Semaphore semaphore;
+    vk::PipelineStageFlags stages;
+    uint64_t value;
+    bool isTimeline; ///< timeline semaphores need their value submitted, even when it is 0
+  };
+
+  /// \brief A semaphore to signal from a submission, with the value to set if it is a timeline semaphore
+  struct SemaphoreSignal
+  {
+    vk::Semaphore semaphore;
+    uint64_t value;
+    bool isTimeline;
+  };
+
+  ///
+  /// \brief A semaphore holding a monotonically increasing 64-bit value, which the host and the device can both signal and wait on
+  ///
+  /// A single timeline can track the completion of every frame: frame N signals N, and "is frame N done" is `getValue() >= N`,
+  /// replacing a fence per frame in flight.
+  /// Requires Vulkan 1.2 (see the `Instance` API version) and the `timelineSemaphore` feature, enabled through `vk::PhysicalDeviceVulkan12Features`.
+  ///
+  class TimelineSemaphore
+  {
+    Device<claws::no_delete> device;
+    Semaphore<> semaphore;
+
+  public:
+    TimelineSemaphore(Device<claws::no_delete> device, uint64_t initialValue = 0u)
+      : device(device)
+      , semaphore(device.createTimelineSemaphore(initialValue))
+    {}
+
+    TimelineSemaphore(TimelineSemaphore const &) = delete;
+    TimelineSemaphore(TimelineSemaphore &&) = default;
+
+    TimelineSemaphore &operator=(TimelineSemaphore const &) = delete;
+    TimelineSemaphore &operator=(TimelineSemaphore &&) = default;
+
+    /// \brief Returns the current value, without waiting
+    uint64_t getValue() const
+    {
+      return device.getSemaphoreCounterValue(semaphore);
+    }
+
+    /// \brief Sets the value from the host, which must be greater than the current one
+    void signal(uint64_t value) const
+    {
+      device.signalSemaphore(vk::SemaphoreSignalInfo{semaphore, value});
+    }
+
+    /// \brief Blocks until the value is at least `value`, returns `false` if `timeout` nanoseconds elapsed first
+    bool wait(uint64_t value, uint64_t timeout = ~0ull) const
+    {
+      vk::Semaphore const rawSemaphore(semaphore);
+
+      return device.waitSemaphores(vk::SemaphoreWaitInfo{{}, 1u, &rawSemaphore, &value}, timeout) == vk::Result::eSuccess;
+    }
+
+    /// \brief Describes a wait on this timeline reaching `value`, at `stages`, for `SubmissionBatcher::enqueue`
+    SemaphoreWait waitAt(uint64_t value, vk::PipelineStageFlags stages) const
+    {
+      return {semaphore, stages, value, true};
+    }
+
+    /// \brief Describes a signal of this timeline to `value`, for `SubmissionBatcher::enqueue`
+    SemaphoreSignal signalAt(uint64_t value) const
+    {
+      return {semaphore, value, true};
+    }
+
+    Semaphore<claws::no_delete> getSemaphore() const noexcept
+    {
+      return semaphore;
+    }
+  };
+};
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace magma
+{
+  namespace impl
+  {
+    inline unsigned findLastSet(uint64_t value) noexcept
+    {
+      assert(value);
+#ifdef _MSC_VER
+      unsigned long index;
+
+      _BitScanReverse64(&index, value);
+      return static_cast<unsigned>(index);
+#else
+      return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+    }
+
+    inline unsigned findFirstSet(uint64_t value) noexcept
+    {
+      assert(value);
+#ifdef _MSC_VER
+      unsigned long index;
+
+      _BitScanForward64(&index, value);
+      return static_cast<unsigned>(index);
+#else
+      return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+    }
+  }
+
+  ///
+  /// \brief Two-level segregated fit allocator over the offsets `[0, capacity)`
+  ///
+  /// Only does the book-keeping: no memory is touched, offsets are handed out for the user to place data at.
+  /// `allocate` and `deallocate` run in constant time, free physical neighbours are coalesced on deallocation.
+  /// Failure to allocate is reported with an empty `std::optional`, so callers can cheaply try several allocators.
+  ///
+  template<class Size = uint32_t>
+  class TlsfAllocator
+  {
+    static_assert(std::is_unsigned_v<Size>);
+
+    static constexpr unsigned secondLevelLog2{4u};
+    static constexpr unsigned secondLevelCount{1u << secondLevelLog2};
+    static constexpr unsigned firstLevelCount{std::numeric_limits<Size>::digits - secondLevelLog2 + 1u};
+    static constexpr uint32_t nil{~0u};
+
+    struct Block
+    {
+      Size offset;
+      Size size;
+      uint32_t prevPhysical;
+      uint32_t nextPhysical;
+      uint32_t prevFree;
+      uint32_t nextFree;
+      bool isFree;
+    };
+
+    Size capacity;
+    Size allocatedSize;
+    std::vector<Block> blocks;
+    std::vector<uint32_t> unusedBlocks;
+    std::unordered_map<Size, uint32_t> usedBlocks;
+    uint64_t firstLevelBitmap;
+    std::array<uint32_t, firstLevelCount> secondLevelBitmaps;
+    std::array<std::array<uint32_t, secondLevelCount>, firstLevelCount> freeLists;
+
+    static std::pair<unsigned, unsigned> mapping(Size size) noexcept
+    {
+      if (size < secondLevelCount)
+        return {0u, static_cast<unsigned>(size)};
+
+      unsigned const lastSet(impl::findLastSet(size));
+
+      return {lastSet - secondLevelLog2 + 1u, static_cast<unsigned>(size >> (lastSet - secondLevelLog2)) - secondLevelCount};
+    }
+
+    /// rounds `size` up to the next list boundary, so that every block of the returned list is big enough
+    static std::optional<std::pair<unsigned, unsigned>> searchMapping(Size size) noexcept
+    {
+      if (size >= secondLevelCount)
+        {
+          Size const round((Size(1u) << (impl::findLastSet(size) - secondLevelLog2)) - 1u);
+
+          if (size > std::numeric_limits<Size>::max() - round)
+            return std::nullopt;
+          size += round;
+        }
+      return mapping(size);
+    }
+
+    uint32_t findFree(unsigned firstLevel, unsigned secondLevel) const noexcept
+    {
+      uint32_t secondLevelMap(secondLevelBitmaps[firstLevel] & (~0u << secondLevel));
+
+      if (!secondLevelMap)
+        {
+          uint64_t const firstLevelMap(firstLevel + 1u < 64u ? firstLevelBitmap & (~0ull << (firstLevel + 1u)) : 0u);
+
+          if (!firstLevelMap)
+            return nil;
+          firstLevel = impl::findFirstSet(firstLevelMap);
+          secondLevelMap = secondLevelBitmaps[firstLevel];
+        }
+      return freeLists[firstLevel][impl::findFirstSet(secondLevelMap)];
+    }
+
+    void insertFree(uint32_t index) noexcept
+    {
+      auto const [firstLevel, secondLevel] = mapping(blocks[index].size);
+      uint32_t &head(freeLists[firstLevel][secondLevel]);
+
+      blocks[index].isFree = true;
+      blocks[index].prevFree = nil;
+      blocks[index].nextFree = head;
+      if (head != nil)
+        blocks[head].prevFree = index;
+      head = index;
+      firstLevelBitmap |= 1ull << firstLevel;
+      secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+    }
+
+    void removeFree(uint32_t index) noexcept
+    {
+      auto const [firstLevel, secondLevel] = mapping(blocks[index].size);
+      Block &block(blocks[index]);
+
+      if (block.prevFree != nil)
+        blocks[block.prevFree].nextFree = block.nextFree;
+      else
+        freeLists[firstLevel][secondLevel] = block.nextFree;
+      if (block.nextFree != nil)
+        blocks[block.nextFree].prevFree = block.prevFree;
+      if (freeLists[firstLevel][secondLevel] == nil)
+        {
+          secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+          if (!secondLevelBitmaps[firstLevel])
+            firstLevelBitmap &= ~(1ull << firstLevel);
+        }
+      block.isFree = false;
+    }
+
+    uint32_t createBlock(Block const &block)
+    {
+      if (unusedBlocks.empty())
+        {
+          blocks.push_back(block);
+          return static_cast<uint32_t>(blocks.size() - 1);
+        }
+      uint32_t const index(unusedBlocks.back());
+
+      unusedBlocks.pop_back();
+      blocks[index] = block;
+      return index;
+    }
+
+    /// merges `index` into its previous physical neighbour, returns the index of the merged block
+    uint32_t absorbIntoPrev(uint32_t index)
+    {
+      Block const &block(blocks[index]);
+      uint32_t const prev(block.prevPhysical);
+
+      blocks[prev].size += block.size;
+      blocks[prev].nextPhysical = block.nextPhysical;
+      if (block.nextPhysical != nil)
+        blocks[block.nextPhysical].prevPhysical = prev;
+      unusedBlocks.push_back(index);
+      return prev;
+    }
+
+    /// splits the tail of `index` past `size` into a new free block, coalescing it with the next block when possible
+    void splitTail(uint32_t index, Size size)
+    {
+      uint32_t const tail(createBlock({blocks[index].offset + size, blocks[index].size - size, index, blocks[index].nextPhysical, nil, nil, false}));
+      Block &block(blocks[index]);
+
+      if (block.nextPhysical != nil)
+        blocks[block.nextPhysical].prevPhysical = tail;
+      block.nextPhysical = tail;
+      block.size = size;
+
+      uint32_t const next(blocks[tail].nextPhysical);
+
+      if (next != nil && blocks[next].isFree)
+        {
+          removeFree(next);
+          absorbIntoPrev(next);
+        }
+      insertFree(tail);
+    }
+
+    static Size getPadding(Size offset, Size alignment) noexcept
+    {
+      return (alignment - (offset & (alignment - 1u))) & (alignment - 1u);
+    }
+
+    bool fitsAligned(uint32_t index, Size size, Size alignment) const noexcept
+    {
+      Size const padding(getPadding(blocks[index].offset, alignment));
+
+      return blocks[index].size >= padding && blocks[index].size - padding >= size;
+    }
+
+    /// splits the first `padding` units of `index` into a free block, returns the index of the remaining block
+    /// the previous physical block of a free block is never free, so there is nothing to coalesce
+    uint32_t splitHead(uint32_t index, Size padding)
+    {
+      uint32_t const rest(createBlock({blocks[index].offset + padding, blocks[index].size - padding, index, blocks[index].nextPhysical, nil, nil, false}));
+      Block &head(blocks[index]);
+
+      if (head.nextPhysical != nil)
+        blocks[head.nextPhysical].prevPhysical = rest;
+      head.nextPhysical = rest;
+      head.size = padding;
+      insertFree(index);
+      return rest;
+    }
+
+  public:
+    TlsfAllocator(Size capacity = 0u)
+      : capacity(capacity)
+      , allocatedSize(0u)
+      , blocks()
+      , unusedBlocks()
+      , usedBlocks()
+      , firstLevelBitmap(0u)
+      , secondLevelBitmaps{}
+    {
+      for (auto &lists : freeLists)
+        lists.fill(nil);
+      if (capacity)
+        insertFree(createBlock({0u, capacity, nil, nil, nil, nil, false}));
+    }
+
+    ///
+    /// \brief Reserves `size` units at an offset that is a multiple of `alignment`
+    ///
+    /// A `size` of 0 is treated as 1, so that every allocation has a distinct offset.
+    /// `alignment` must be a power of two.
+    /// The first block of the matching size class is tried before falling back to a worst-case padded search,
+    /// so that small aligned allocations still pack tightly. Padding left in front of an allocation stays free.
+    /// @return the offset of the allocation, or `std::nullopt` if no free block is big enough.
+    ///
+    std::optional<Size> allocate(Size size, Size alignment = 1u)
+    {
+      assert(alignment && !(alignment & (alignment - 1u)));
+      size = std::max(size, Size(1u));
+
+      uint32_t index(nil);
+
+      if (auto const lists = searchMapping(size))
+        {
+          index = findFree(lists->first, lists->second);
+          if (index != nil && !fitsAligned(index, size, alignment))
+            index = nil;
+        }
+      if (index == nil && alignment > 1u && size <= std::numeric_limits<Size>::max() - (alignment - 1u))
+        if (auto const lists = searchMapping(size + (alignment - 1u)))
+          index = findFree(lists->first, lists->second);
+      if (index == nil)
+        return std::nullopt;
+      removeFree(index);
+
+      Size const padding(getPadding(blocks[index].offset, alignment));
+
+      if (padding)
+        index = splitHead(index, padding);
+      if (blocks[index].size > size)
+        splitTail(index, size);
+      allocatedSize += size;
+      usedBlocks.emplace(blocks[index].offset, index);
+      return blocks[index].offset;
+    }
+
+    ///
+    /// \brief Releases the allocation starting at `offset`
+    ///
+    /// @return the size of the released allocation.
+    ///
+    Size deallocate(Size offset)
+    {
+      auto it(usedBlocks.find(offset));
+
+      assert(it != usedBlocks.end());
+
+      uint32_t index(it->second);
+      Size const size(blocks[index].size);
+
+      usedBlocks.erase(it);
+      allocatedSize -= size;
+
+      uint32_t const next(blocks[index].nextPhysical);
+
+      if (next != nil && blocks[next].isFree)
+        {
+          removeFree(next);
+          absorbIntoPrev(next);
+        }
+
+      uint32_t const prev(blocks[index].prevPhysical);
+
+      if (prev != nil && blocks[prev].isFree)
+        {
+          removeFree(prev);
+          index = absorbIntoPrev(index);
+        }
+      insertFree(index);
+      return size;
+    }
+
+    ///
+    /// \brief Changes the size of the allocation starting at `offset` in place
+    ///
+    /// Growing only succeeds if the next physical block is free and large enough.
+    /// @return whether the allocation now has the requested size.
+    ///
+    bool resize(Size offset, Size size)
+    {
+      uint32_t const index(usedBlocks.at(offset));
+      Size const oldSize(blocks[index].size);
+
+      size = std::max(size, Size(1u));
+      if (size < blocks[index].size)
+        splitTail(index, size);
+      else if (size > blocks[index].size)
+        {
+          uint32_t const next(blocks[index].nextPhysical);
+          Size const missing(size - blocks[index].size);
+
+          if (next == nil || !blocks[next].isFree || blocks[next].size < missing)
+            return false;
+          removeFree(next);
+          if (blocks[next].size == missing)
+            absorbIntoPrev(next);
+          else
+            {
+              blocks[next].offset += missing;
+              blocks[next].size -= missing;
+              blocks[index].size = size;
+              insertFree(next);
+            }
+        }
+      allocatedSize += size;
+      allocatedSize -= oldSize;
+      return true;
+    }
+
+    Size getSize(Size offset) const
+    {
+      return blocks[usedBlocks.at(offset)].size;
+    }
+
+    bool isAllocated(Size offset) const
+    {
+      return usedBlocks.count(offset);
+    }
+
+    /// \brief Calls `func(offset, size)` for every allocation, in no particular order
+    template<class Func>
+    void forEachAllocation(Func &&func) const
+    {
+      for (auto const &[offset, index] : usedBlocks)
+        func(offset, blocks[index].size);
+    }
+
+    Size getAllocatedSize() const noexcept
+    {
+      return allocatedSize;
+    }
+
+    Size getCapacity() const noexcept
+    {
+      return capacity;
+    }
+
+    std::size_t getAllocationCount() const noexcept
+    {
+      return usedBlocks.size();
+    }
+  };
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <map>
+#include <optional>
+#include <tuple>
+
+#include "magma/CommandBuffer.hpp"
+#include "magma/DynamicBuffer.hpp"
+#include "magma/Fence.hpp"
+#include "magma/Image.hpp"
+#include "magma/QueueFamily.hpp"
+#include "magma/VulkanFormatsHandler.hpp"
+
+namespace magma
+{
+  ///
+  /// \brief Batches buffer and image uploads through a shared staging arena
+  ///
+  /// Uploads are copied to persistently mapped staging memory right away, and recorded as a single command buffer by `flush`,
+  /// with one `copyBuffer` or `copyBufferToImage` per destination.
+  /// Each flush returns a token, which `isComplete` and `wait` use to tell when the uploads it contains have landed.
+  ///
+  /// Destination images must be in the layout given to `uploadImage` when the batch executes.
+  /// When the queue belongs to another family than the one using the resources (e.g. a dedicated transfer family),
+  /// resources must either be shared concurrently, or have their ownership transferred by the caller.
+  ///
+  class UploadManager
+  {
+  public:
+    using Token = uint64_t;
+
+  private:
+    struct Batch
+    {
+      CommandBufferGroup<PrimaryCommandBuffer> commandBuffers;
+      Fence<> fence;
+      std::vector<DynamicBuffer::RangeId> stagingRanges;
+    };
+
+    Device<claws::no_delete> device;
+    vk::Queue queue;
+    DynamicBuffer staging;
+    CommandPool<> commandPool;
+    vk::DeviceSize bufferCopyAlignment;
+    vk::DeviceSize imageCopyAlignment;
+    std::map<std::pair<vk::Buffer, vk::Buffer>, std::vector<vk::BufferCopy>> bufferCopies;
+    std::map<std::tuple<vk::Buffer, vk::Image, vk::ImageLayout>, std::vector<vk::BufferImageCopy>> imageCopies;
+    std::vector<DynamicBuffer::RangeId> stagingRanges;
+    std::deque<Batch> batches;
+    Token submittedToken;
+    Token completedToken;
+
+    ///
+    /// \brief Copies `data` to a new staging range, at an offset that is a multiple of `alignment`
+    ///
+    /// `alignment` doesn't have to be a power of two: the range is aligned to its largest power of two factor,
+    /// and padded so that the rest of the alignment can be reached inside it.
+    /// @return the staging range, and the offset of the data in its buffer.
+    ///
+    std::pair<DynamicBuffer::RangeId, vk::DeviceSize> stage(void const *data, vk::DeviceSize size, vk::DeviceSize alignment)
+    {
+      vk::DeviceSize const powerOfTwoAlignment(alignment & ~(alignment - 1u));
+      auto const range(staging.allocate(size + alignment - powerOfTwoAlignment, powerOfTwoAlignment));
+      vk::DeviceSize const offset((range.second + alignment - 1u) / alignment * alignment);
+
+      stagingRanges.push_back(range);
+      std::memcpy(staging.getMemory<char[]>(range).get() + (offset - range.second), data, size);
+      return {range, offset};
+    }
+
+    /// \brief Returns the alignment of image copies from the staging buffer, which must be a multiple of the texel block size and of 4
+    vk::DeviceSize getImageCopyAlignment(vk::Format format) const noexcept
+    {
+      using namespace vulkanFormatGroups;
+
+      // every other format's texel block size is a power of two no bigger than 16 bytes
+      constexpr FormatGroup threeComponentFormats(R8G8B8 | B8G8R8 | R16G16B16 | R32G32B32 | R64G64B64);
+
+      return threeComponentFormats[format] ? imageCopyAlignment * 3u : imageCopyAlignment;
+    }
+
+  public:
+    ///
+    /// \brief Returns a queue family that supports transfers but neither graphics nor compute, if there is one
+    ///
+    /// Such families usually map to the DMA engines, and let uploads run alongside rendering.
+    ///
+    static std::optional<uint32_t> findDedicatedTransferQueueFamily(vk::PhysicalDevice physicalDevice)
+    {
+      return findQueueFamily(physicalDevice, vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute);
+    }
+
+    UploadManager(Device<claws::no_delete> device, vk::PhysicalDevice physicalDevice, vk::Queue queue, uint32_t queueFamilyIndex)
+      : device(device)
+      , queue(queue)
+      , staging(device,
+                physicalDevice,
+                {},
+                vk::BufferUsageFlagBits::eTransferSrc,
+                vk::MemoryPropertyFlagBits::eHostVisible,
+                {},
+                DynamicBuffer::MappingMode::persistent)
+      , commandPool(device.createCommandPool(vk::CommandPoolCreateFlagBits::eTransient, queueFamilyIndex))
+      , submittedToken(0u)
+      , completedToken(0u)
+    {
+      auto const limits(physicalDevice.getProperties().limits);
+
+      bufferCopyAlignment = std::max(limits.optimalBufferCopyOffsetAlignment, vk::DeviceSize(4u));
+      // covers the power of two texel and block sizes `bufferOffset` must be a multiple of, see `getImageCopyAlignment`
+      imageCopyAlignment = std::max(limits.optimalBufferCopyOffsetAlignment, vk::DeviceSize(16u));
+    }
+
+    UploadManager(UploadManager const &) = delete;
+    UploadManager(UploadManager &&) = default;
+
+    UploadManager &operator=(UploadManager const &) = delete;
+    UploadManager &operator=(UploadManager &&) = delete;
+
+    ///
+    /// \brief Queues `size` bytes of `data` to be copied to `destination` at `offset`
+    ///
+    /// `data` is copied to staging memory before returning.
+    /// @return the token of the batch the upload will be part of.
+    ///
+    Token uploadBuffer(Buffer<claws::no_delete> destination, vk::DeviceSize offset, void const *data, vk::DeviceSize size)
+    {
+      auto const [range, stagingOffset] = stage(data, size, bufferCopyAlignment);
+
+      bufferCopies[{staging.getBuffer(range), destination}].push_back({stagingOffset, offset, size});
+      return submittedToken + 1;
+    }
+
+    template<class Container>
+    Token uploadBuffer(Buffer<claws::no_delete> destination, vk::DeviceSize offset, Container const &data)
+    {
+      return uploadBuffer(destination, offset, data.data(), sizeof(*data.data()) * data.size());
+    }
+
+    ///
+    /// \brief Queues `size` bytes of `data` to be copied to `destination`, as described by `region`
+    ///
+    /// `region.bufferOffset` is filled in by the manager, aligned for `format`, the format of `destination`.
+    /// `destination` must be in `layout` when the batch executes, which must be `eTransferDstOptimal` or `eGeneral`.
+    /// @return the token of the batch the upload will be part of.
+    ///
+    Token uploadImage(Image<claws::no_delete> destination,
+                      vk::Format format,
+                      vk::ImageLayout layout,
+                      vk::BufferImageCopy region,
+                      void const *data,
+                      vk::DeviceSize size)
+    {
+      auto const [range, stagingOffset] = stage(data, size, getImageCopyAlignment(format));
+
+      region.bufferOffset = stagingOffset;
+      imageCopies[{staging.getBuffer(range), destination, layout}].push_back(region);
+      return submittedToken + 1;
+    }
+
+    ///
+    /// \brief Records and submits every queued upload as one batch
+    ///
+    /// @return the token of the submitted batch, or of the last one if nothing was queued.
+    ///
+    Token flush()
+    {
+      if (stagingRanges.empty())
+        return submittedToken;
+
+      auto commandBuffers(commandPool.allocatePrimaryCommandBuffers(1));
+      PrimaryCommandBuffer commandBuffer(static_cast<std::vector<vk::CommandBuffer> const &>(commandBuffers)[0]);
+
+      commandBuffer.begin(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+      for (auto const &[buffers, regions] : bufferCopies)
+        commandBuffer.copyBuffer(buffers.first, buffers.second, regions);
+      for (auto const &[destination, regions] : imageCopies)
+        commandBuffer.copyBufferToImage(std::get<0>(destination), std::get<1>(destination), std::get<2>(destination), regions);
+      commandBuffer.end();
+
+      auto fence(device.createFence({}));
+      vk::CommandBuffer const rawCommandBuffer(commandBuffer.raw());
+
+      queue.submit({vk::SubmitInfo{0, nullptr, nullptr, 1, &rawCommandBuffer, 0, nullptr}}, fence);
+      batches.push_back({std::move(commandBuffers), std::move(fence), std::move(stagingRanges)});
+      stagingRanges.clear();
+      bufferCopies.clear();
+      imageCopies.clear();
+      return ++submittedToken;
+    }
+
+    /// \brief Releases the staging memory and command buffers of completed batches, in submission order
+    void update()
+    {
+      while (!batches.empty() && device.getFenceStatus(batches.front().fence) == vk::Result::eSuccess)
+        {
+          for (auto const &range : batches.front().stagingRanges)
+            staging.free(range);
+          batches.pop_front();
+          ++completedToken;
+        }
+    }
+
+    bool isComplete(Token token)
+    {
+      update();
+      return token <= completedToken;
+    }
+
+    /// \brief Blocks until the batch of `token` is complete, flushing it first if it is still being queued
+    void wait(Token token)
+    {
+      if (token > submittedToken)
+        flush();
+      update();
+      while (completedToken < token && !batches.empty())
+        {
+          vk::Fence const fence(batches.front().fence);
+
+          device.waitForFences({fence}, true, ~0ull);
+          update();
+        }
+    }
+
+    ~UploadManager()
+    {
+      wait(submittedToken);
+    }
+  };
+};
@@ -110,16 +110,21 @@ namespace magma
       return {std::get<1>(*it), std::get<2>(*it)};
     }
 
-    Instance(std::vector<char const *> &&extensions = {})
-      : vkInstance([](std::vector<char const *> &&extensions) {
-        vk::ApplicationInfo appInfo("Wasted Prophecies", VK_MAKE_VERSION(1, 0, 0), nullptr, VK_MAKE_VERSION(1, 0, 0), VK_API_VERSION_1_0);
+    ///
+    /// \brief Creates the instance, for devices up to `apiVersion`
+    ///
+    /// Features of later versions (e.g. timeline semaphores, which are core in Vulkan 1.2) require asking for them here.
+    ///
+    Instance(std::vector<char const *> &&extensions = {}, uint32_t apiVersion = VK_API_VERSION_1_0)
+      : vkInstance([](std::vector<char const *> &&extensions, uint32_t apiVersion) {
+        vk::ApplicationInfo appInfo("Wasted Prophecies", VK_MAKE_VERSION(1, 0, 0), nullptr, VK_MAKE_VERSION(1, 0, 0), apiVersion);
 #ifdef DEBUG_LAYERS
         auto validationLayers = make_const_char_array("VK_LAYER_LUNARG_standard_validation");
         extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 #endif
 
         vk::InstanceCreateInfo instanceCreateInfo({},
-                                                  nullptr,
+                                                  &appInfo,
 #ifdef DEBUG_LAYERS
                                                   static_cast<uint32_t>(validationLayers.size()),
                                                   validationLayers.data(),
@@ -131,7 +136,7 @@ namespace magma
                                                   extensions.data());
 
         return vk::createInstance(instanceCreateInfo);
-	}(std::move(extensions)))
+	}(std::move(extensions), apiVersion))
 #ifdef DEBUG_LAYERS
       , callback([](vk::Instance vkInstance) {
         vk::DebugReportCallbackCreateInfoEXT createInfo{vk::DebugReportFlagBitsEXT::eError | vk::DebugReportFlagBitsEXT::eWarning,
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace magma
+{
+  ///
+  /// \brief A fixed set of worker threads, each with its own task queue, that steal from each other when idle
+  ///
+  /// Workers pop their own queue from the back, and steal from the front of the others, so contention only happens when queues run low.
+  /// The thread calling `parallelFor` runs tasks too while it waits, so nested or recursive use doesn't deadlock.
+  ///
+  class WorkStealingThreadPool
+  {
+    struct Queue
+    {
+      std::deque<std::function<void()>> tasks;
+      std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<std::size_t> queuedCount;
+    std::atomic<uint32_t> nextQueue;
+    bool stopping;
+
+    bool tryRun(std::size_t firstQueue)
+    {
+      std::function<void()> task;
+
+      for (std::size_t i(0u); i < queues.size() && !task; ++i)
+        {
+          Queue &queue(*queues[(firstQueue + i) % queues.size()]);
+          std::lock_guard<std::mutex> lock(queue.mutex);
+
+          if (queue.tasks.empty())
+            continue;
+          if (!i)
+            {
+              task = std::move(queue.tasks.back());
+              queue.tasks.pop_back();
+            }
+          else
+            {
+              task = std::move(queue.tasks.front());
+              queue.tasks.pop_front();
+            }
+        }
+      if (!task)
+        return false;
+      --queuedCount;
+      task();
+      return true;
+    }
+
+    void work(std::size_t queueIndex)
+    {
+      while (true)
+        {
+          if (tryRun(queueIndex))
+            continue;
+
+          std::unique_lock<std::mutex> lock(sleepMutex);
+
+          wakeUp.wait(lock, [this]() { return stopping || queuedCount; });
+          if (stopping && !queuedCount)
+            return;
+        }
+    }
+
+    void push(std::function<void()> &&task)
+    {
+      Queue &queue(*queues[nextQueue++ % queues.size()]);
+
+      {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        queue.tasks.push_back(std::move(task));
+      }
+      {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+
+        ++queuedCount;
+      }
+      wakeUp.notify_one();
+    }
+
+  public:
+    WorkStealingThreadPool(uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1u)
+      : queuedCount(0u)
+      , nextQueue(0u)
+      , stopping(false)
+    {
+      for (uint32_t i(0u); i < std::max(threadCount, 1u); ++i)
+        queues.push_back(std::make_unique<Queue>());
+      for (uint32_t i(0u); i < threadCount; ++i)
+        threads.emplace_back([this, i]() { work(i); });
+    }
+
+    WorkStealingThreadPool(WorkStealingThreadPool const &) = delete;
+    WorkStealingThreadPool(WorkStealingThreadPool &&) = delete;
+
+    WorkStealingThreadPool &operator=(WorkStealingThreadPool const &) = delete;
+    WorkStealingThreadPool &operator=(WorkStealingThreadPool &&) = delete;
+
+    ~WorkStealingThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+
+        stopping = true;
+      }
+      wakeUp.notify_all();
+      for (auto &thread : threads)
+        thread.join();
+    }
+
+    uint32_t getThreadCount() const noexcept
+    {
+      return static_cast<uint32_t>(threads.size());
+    }
+
+    ///
+    /// \brief Calls `func(i)` for every `i` in `[0, count)`, spread over the workers, and returns once all calls are done
+    ///
+    /// If calls throw, the first exception is rethrown once every call has finished.
+    ///
+    template<class Func>
+    void parallelFor(std::size_t count, Func &&func)
+    {
+      std::atomic<std::size_t> remaining(count);
+      std::exception_ptr exception;
+      std::mutex exceptionMutex;
+
+      for (std::size_t i(0u); i < count; ++i)
+        push([&, i]() {
+          try
+            {
+              func(i);
+            }
+          catch (...)
+            {
+              std::lock_guard<std::mutex> lock(exceptionMutex);
+
+              if (!exception)
+                exception = std::current_exception();
+            }
+          --remaining;
+        });
+      while (remaining)
+        if (!tryRun(nextQueue % queues.size()))
+          std::this_thread::yield();
+      if (exception)
+        std::rethrow_exception(exception);
+    }
+  };
+};
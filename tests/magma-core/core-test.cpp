@@ -2,9 +2,500 @@
 // Created by doom on 28/07/18.
 //
 
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
 #include <gtest/gtest.h>
 
+#include "magma/BarrierBatcher.hpp"
+#include "magma/FrameGraph.hpp"
+#include "magma/StateTracker.hpp"
+#include "magma/SubmissionBatcher.hpp"
+#include "magma/TlsfAllocator.hpp"
+#include "magma/WorkStealingThreadPool.hpp"
+
+#include "vulkan-stubs.hpp"
+
+using stubs::FakeDevice;
+using stubs::fakeHandle;
+using stubs::recorded;
+
 TEST(dummy_case, dummy_test)
 {
     ASSERT_EQ(0, 0);
 }
+
+TEST(tlsf_allocator, splits_free_blocks)
+{
+    magma::TlsfAllocator<uint32_t> allocator(1024u);
+
+    ASSERT_EQ(allocator.allocate(100u), 0u);
+    ASSERT_EQ(allocator.allocate(50u), 100u);
+    ASSERT_EQ(allocator.getSize(0u), 100u);
+    ASSERT_EQ(allocator.getSize(100u), 50u);
+    ASSERT_EQ(allocator.getAllocatedSize(), 150u);
+    ASSERT_EQ(allocator.getAllocationCount(), 2u);
+}
+
+TEST(tlsf_allocator, coalesces_on_free)
+{
+    magma::TlsfAllocator<uint32_t> allocator(384u);
+
+    ASSERT_EQ(allocator.allocate(128u), 0u);
+    ASSERT_EQ(allocator.allocate(128u), 128u);
+    ASSERT_EQ(allocator.allocate(128u), 256u);
+    ASSERT_EQ(allocator.deallocate(0u), 128u);
+    ASSERT_EQ(allocator.deallocate(256u), 128u);
+    ASSERT_FALSE(allocator.allocate(256u));
+    // freeing the middle block merges it with both neighbours
+    ASSERT_EQ(allocator.deallocate(128u), 128u);
+    ASSERT_EQ(allocator.getAllocationCount(), 0u);
+    ASSERT_EQ(allocator.allocate(384u), 0u);
+}
+
+TEST(tlsf_allocator, resizes_in_place)
+{
+    magma::TlsfAllocator<uint32_t> allocator(1024u);
+
+    ASSERT_EQ(allocator.allocate(100u), 0u);
+    ASSERT_TRUE(allocator.resize(0u, 200u));
+    ASSERT_EQ(allocator.getSize(0u), 200u);
+    ASSERT_EQ(allocator.allocate(100u), 200u);
+    ASSERT_FALSE(allocator.resize(0u, 250u));
+    ASSERT_TRUE(allocator.resize(0u, 64u));
+    ASSERT_EQ(allocator.getSize(0u), 64u);
+    ASSERT_EQ(allocator.getAllocatedSize(), 164u);
+    // the space given back by shrinking is free again
+    ASSERT_EQ(allocator.allocate(136u), 64u);
+}
+
+TEST(tlsf_allocator, reports_exhaustion)
+{
+    magma::TlsfAllocator<uint32_t> allocator(256u);
+
+    ASSERT_EQ(allocator.allocate(256u), 0u);
+    ASSERT_FALSE(allocator.allocate(1u));
+    allocator.deallocate(0u);
+    ASSERT_FALSE(allocator.allocate(257u));
+    ASSERT_EQ(allocator.allocate(128u), 0u);
+    ASSERT_EQ(allocator.allocate(128u), 128u);
+    ASSERT_FALSE(allocator.allocate(1u));
+}
+
+TEST(tlsf_allocator, aligns_allocations)
+{
+    magma::TlsfAllocator<uint32_t> allocator(1024u);
+
+    ASSERT_EQ(allocator.allocate(1u), 0u);
+
+    auto const aligned(allocator.allocate(8u, 64u));
+
+    ASSERT_TRUE(aligned);
+    ASSERT_EQ(*aligned % 64u, 0u);
+    ASSERT_EQ(*aligned, 64u);
+    // the padding in front of the aligned allocation stays free
+    ASSERT_EQ(allocator.allocate(62u), 1u);
+    ASSERT_FALSE(allocator.allocate(2000u, 16u));
+}
+
+TEST(work_stealing_thread_pool, runs_every_index_once)
+{
+    magma::WorkStealingThreadPool threadPool(3u);
+    std::vector<std::atomic<int>> calls(1000u);
+
+    threadPool.parallelFor(calls.size(), [&](std::size_t i) { ++calls[i]; });
+    for (auto const &count : calls)
+        ASSERT_EQ(count, 1);
+}
+
+TEST(work_stealing_thread_pool, runs_on_the_calling_thread_without_workers)
+{
+    magma::WorkStealingThreadPool threadPool(0u);
+    std::atomic<std::size_t> sum(0u);
+
+    ASSERT_EQ(threadPool.getThreadCount(), 0u);
+    threadPool.parallelFor(100u, [&](std::size_t i) { sum += i; });
+    ASSERT_EQ(sum, 4950u);
+}
+
+TEST(work_stealing_thread_pool, supports_nested_loops)
+{
+    magma::WorkStealingThreadPool threadPool(2u);
+    std::atomic<std::size_t> count(0u);
+
+    threadPool.parallelFor(8u, [&](std::size_t) { threadPool.parallelFor(8u, [&](std::size_t) { ++count; }); });
+    ASSERT_EQ(count, 64u);
+}
+
+TEST(work_stealing_thread_pool, rethrows_after_every_call)
+{
+    magma::WorkStealingThreadPool threadPool(2u);
+    std::atomic<std::size_t> count(0u);
+
+    ASSERT_THROW(threadPool.parallelFor(50u,
+                                        [&](std::size_t i) {
+                                            ++count;
+                                            if (i == 10u)
+                                                throw std::runtime_error("expected");
+                                        }),
+                 std::runtime_error);
+    ASSERT_EQ(count, 50u);
+}
+
+TEST(barrier_batcher, merges_overlapping_buffer_ranges)
+{
+    magma::BarrierBatcher barriers;
+    auto const buffer(fakeHandle<vk::Buffer>(1u));
+
+    recorded = {};
+    barriers.addBufferBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                              vk::PipelineStageFlagBits::eVertexInput,
+                              {vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eVertexAttributeRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, buffer, 0u, 16u});
+    barriers.addBufferBarrier(vk::PipelineStageFlagBits::eTransfer,
+                              vk::PipelineStageFlagBits::eVertexInput,
+                              {vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eVertexAttributeRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, buffer, 8u, 16u});
+    barriers.flush(fakeHandle<vk::CommandBuffer>(1u));
+    ASSERT_EQ(recorded.pipelineBarrierCount, 1u);
+    ASSERT_EQ(vk::PipelineStageFlags(recorded.srcStages), vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer);
+    ASSERT_EQ(recorded.bufferBarriers.size(), 1u);
+    ASSERT_EQ(recorded.bufferBarriers[0].offset, 0u);
+    ASSERT_EQ(recorded.bufferBarriers[0].size, 24u);
+    ASSERT_EQ(vk::AccessFlags(recorded.bufferBarriers[0].srcAccessMask), vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite);
+    ASSERT_TRUE(barriers.empty());
+}
+
+TEST(barrier_batcher, merges_barriers_reached_by_a_widened_range)
+{
+    magma::BarrierBatcher barriers;
+    auto const buffer(fakeHandle<vk::Buffer>(1u));
+    auto const other(fakeHandle<vk::Buffer>(2u));
+    vk::BufferMemoryBarrier const barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, buffer, 0u, 16u};
+
+    recorded = {};
+    for (vk::DeviceSize const offset : {0u, 32u, 16u})
+        barriers.addBufferBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::BufferMemoryBarrier(barrier).setOffset(offset));
+    barriers.addBufferBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::BufferMemoryBarrier(barrier).setBuffer(other));
+    barriers.flush(fakeHandle<vk::CommandBuffer>(1u));
+    ASSERT_EQ(recorded.bufferBarriers.size(), 2u);
+    ASSERT_EQ(recorded.bufferBarriers[0].buffer, static_cast<VkBuffer>(buffer));
+    ASSERT_EQ(recorded.bufferBarriers[0].offset, 0u);
+    ASSERT_EQ(recorded.bufferBarriers[0].size, 48u);
+    ASSERT_EQ(recorded.bufferBarriers[1].buffer, static_cast<VkBuffer>(other));
+}
+
+TEST(barrier_batcher, keeps_ownership_transfers_apart)
+{
+    magma::BarrierBatcher barriers;
+    vk::BufferMemoryBarrier const release{vk::AccessFlagBits::eTransferWrite, {}, 0u, 1u, fakeHandle<vk::Buffer>(1u), 0u, VK_WHOLE_SIZE};
+
+    recorded = {};
+    barriers.addBufferBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, release);
+    barriers.addBufferBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, release);
+    barriers.flush(fakeHandle<vk::CommandBuffer>(1u));
+    ASSERT_EQ(recorded.bufferBarriers.size(), 2u);
+}
+
+TEST(barrier_batcher, chains_layout_transitions)
+{
+    magma::BarrierBatcher barriers;
+    auto const image(fakeHandle<vk::Image>(1u));
+    vk::ImageSubresourceRange const range{vk::ImageAspectFlagBits::eColor, 0u, 1u, 0u, 1u};
+
+    recorded = {};
+    barriers.addImageBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                             vk::PipelineStageFlagBits::eTransfer,
+                             {{},
+                              vk::AccessFlagBits::eTransferWrite,
+                              vk::ImageLayout::eUndefined,
+                              vk::ImageLayout::eTransferDstOptimal,
+                              VK_QUEUE_FAMILY_IGNORED,
+                              VK_QUEUE_FAMILY_IGNORED,
+                              image,
+                              range});
+    barriers.addImageBarrier(vk::PipelineStageFlagBits::eTransfer,
+                             vk::PipelineStageFlagBits::eFragmentShader,
+                             {vk::AccessFlagBits::eTransferWrite,
+                              vk::AccessFlagBits::eShaderRead,
+                              vk::ImageLayout::eTransferDstOptimal,
+                              vk::ImageLayout::eShaderReadOnlyOptimal,
+                              VK_QUEUE_FAMILY_IGNORED,
+                              VK_QUEUE_FAMILY_IGNORED,
+                              image,
+                              range});
+    barriers.flush(fakeHandle<vk::CommandBuffer>(1u));
+    ASSERT_EQ(recorded.imageBarriers.size(), 1u);
+    ASSERT_EQ(recorded.imageBarriers[0].oldLayout, VK_IMAGE_LAYOUT_UNDEFINED);
+    ASSERT_EQ(recorded.imageBarriers[0].newLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    ASSERT_EQ(vk::AccessFlags(recorded.imageBarriers[0].dstAccessMask), vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderRead);
+}
+
+TEST(barrier_batcher, records_nothing_when_empty)
+{
+    magma::BarrierBatcher barriers;
+
+    recorded = {};
+    barriers.flush(fakeHandle<vk::CommandBuffer>(1u));
+    ASSERT_EQ(recorded.pipelineBarrierCount, 0u);
+}
+
+TEST(state_tracker, elides_repeated_bindings)
+{
+    magma::StateTracker tracker(fakeHandle<vk::CommandBuffer>(1u));
+    magma::Pipeline<claws::no_delete> const pipeline(fakeHandle<vk::Pipeline>(1u));
+    magma::Buffer<claws::no_delete> const indexBuffer(fakeHandle<vk::Buffer>(1u));
+
+    recorded = {};
+    tracker.bindGraphicsPipeline(pipeline);
+    tracker.bindGraphicsPipeline(pipeline);
+    // each bind point has its own pipeline
+    tracker.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    tracker.bindIndexBuffer(indexBuffer, 0u, vk::IndexType::eUint16);
+    tracker.bindIndexBuffer(indexBuffer, 0u, vk::IndexType::eUint16);
+    tracker.bindIndexBuffer(indexBuffer, 4u, vk::IndexType::eUint16);
+    ASSERT_EQ(recorded.bindCount, 4u);
+    ASSERT_EQ(tracker.getElidedCount(), 2u);
+    tracker.resetElidedCount();
+    ASSERT_EQ(tracker.getElidedCount(), 0u);
+}
+
+TEST(state_tracker, elides_bound_descriptor_sets)
+{
+    magma::StateTracker tracker(fakeHandle<vk::CommandBuffer>(1u));
+    claws::handle<vk::PipelineLayout, claws::no_delete> const layout(fakeHandle<vk::PipelineLayout>(1u));
+    claws::handle<vk::PipelineLayout, claws::no_delete> const otherLayout(fakeHandle<vk::PipelineLayout>(2u));
+    auto const first(fakeHandle<vk::DescriptorSet>(1u));
+    auto const second(fakeHandle<vk::DescriptorSet>(2u));
+
+    recorded = {};
+    tracker.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0u, {first, second});
+    tracker.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0u, {first, second});
+    tracker.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 1u, {second});
+    ASSERT_EQ(recorded.bindCount, 1u);
+    tracker.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0u, {first}, {64u});
+    tracker.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0u, {first}, {64u});
+    tracker.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0u, {first}, {128u});
+    ASSERT_EQ(recorded.bindCount, 3u);
+    // another layout forgets the sets bound with the previous one
+    tracker.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, otherLayout, 0u, {first}, {128u});
+    ASSERT_EQ(recorded.bindCount, 4u);
+    ASSERT_EQ(tracker.getElidedCount(), 3u);
+}
+
+TEST(state_tracker, trims_vertex_buffer_bindings)
+{
+    magma::StateTracker tracker(fakeHandle<vk::CommandBuffer>(1u));
+    auto const a(fakeHandle<vk::Buffer>(1u));
+    auto const b(fakeHandle<vk::Buffer>(2u));
+    auto const c(fakeHandle<vk::Buffer>(3u));
+    auto const d(fakeHandle<vk::Buffer>(4u));
+
+    recorded = {};
+    tracker.bindVertexBuffers(0u, {a, b, c}, {0u, 0u, 0u});
+    ASSERT_EQ(recorded.firstVertexBinding, 0u);
+    ASSERT_EQ(recorded.vertexBindingCount, 3u);
+    tracker.bindVertexBuffers(0u, {a, d, c}, {0u, 0u, 0u});
+    ASSERT_EQ(recorded.firstVertexBinding, 1u);
+    ASSERT_EQ(recorded.vertexBindingCount, 1u);
+    tracker.bindVertexBuffers(0u, {a, d, c}, {0u, 0u, 0u});
+    ASSERT_EQ(recorded.bindCount, 2u);
+    tracker.bindVertexBuffers(1u, {d, c}, {0u, 16u});
+    ASSERT_EQ(recorded.firstVertexBinding, 2u);
+    ASSERT_EQ(recorded.vertexBindingCount, 1u);
+    ASSERT_EQ(recorded.bindCount, 3u);
+    ASSERT_EQ(tracker.getElidedCount(), 1u);
+}
+
+TEST(state_tracker, elides_unchanged_push_constants)
+{
+    magma::StateTracker tracker(fakeHandle<vk::CommandBuffer>(1u));
+    claws::handle<vk::PipelineLayout, claws::no_delete> const layout(fakeHandle<vk::PipelineLayout>(1u));
+    uint32_t const data[2]{1u, 2u};
+    uint32_t const otherData[2]{1u, 3u};
+
+    recorded = {};
+    tracker.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0u, sizeof(data), data);
+    tracker.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0u, sizeof(data), data);
+    tracker.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 4u, 4u, data + 1);
+    ASSERT_EQ(recorded.bindCount, 1u);
+    tracker.pushConstants(layout, vk::ShaderStageFlagBits::eFragment, 0u, sizeof(data), data);
+    tracker.pushConstants(layout, vk::ShaderStageFlagBits::eFragment, 0u, sizeof(otherData), otherData);
+    ASSERT_EQ(recorded.bindCount, 3u);
+    ASSERT_EQ(tracker.getElidedCount(), 2u);
+}
+
+TEST(state_tracker, records_again_after_invalidate)
+{
+    magma::StateTracker tracker(fakeHandle<vk::CommandBuffer>(1u));
+    magma::Pipeline<claws::no_delete> const pipeline(fakeHandle<vk::Pipeline>(1u));
+    auto const buffer(fakeHandle<vk::Buffer>(1u));
+
+    recorded = {};
+    tracker.bindGraphicsPipeline(pipeline);
+    tracker.bindVertexBuffers(0u, {buffer}, {0u});
+    tracker.invalidate();
+    tracker.bindGraphicsPipeline(pipeline);
+    tracker.bindVertexBuffers(0u, {buffer}, {0u});
+    ASSERT_EQ(recorded.bindCount, 4u);
+    ASSERT_EQ(tracker.getElidedCount(), 0u);
+}
+
+TEST(submission_batcher, merges_plain_submissions)
+{
+    magma::SubmissionBatcher batcher(fakeHandle<vk::Queue>(1u));
+
+    recorded = {};
+    for (std::uintptr_t i(1u); i <= 3u; ++i)
+        batcher.enqueue({fakeHandle<vk::CommandBuffer>(i)});
+    ASSERT_EQ(batcher.getBatchCount(), 1u);
+    batcher.flush();
+    ASSERT_EQ(recorded.submitCount, 1u);
+    ASSERT_EQ(recorded.submittedCommandBufferCounts, std::vector<uint32_t>({3u}));
+    ASSERT_EQ(batcher.getBatchCount(), 0u);
+}
+
+TEST(submission_batcher, closes_a_batch_after_a_signal)
+{
+    magma::SubmissionBatcher batcher(fakeHandle<vk::Queue>(1u));
+    auto const semaphore(fakeHandle<vk::Semaphore>(1u));
+    std::vector<magma::SemaphoreWait> const noWaits;
+    std::vector<magma::SemaphoreSignal> const signals{{semaphore, 1u, true}};
+
+    recorded = {};
+    batcher.enqueue({fakeHandle<vk::CommandBuffer>(1u)}, noWaits, signals);
+    batcher.enqueue({fakeHandle<vk::CommandBuffer>(2u)});
+    ASSERT_EQ(batcher.getBatchCount(), 2u);
+    batcher.flush();
+    ASSERT_EQ(recorded.submittedCommandBufferCounts, std::vector<uint32_t>({1u, 1u}));
+    // only the batch with a timeline semaphore is chained to a timeline submit info
+    ASSERT_EQ(recorded.submittedTimelineValues, std::vector<bool>({true, false}));
+}
+
+TEST(submission_batcher, opens_a_batch_for_waits_after_command_buffers)
+{
+    magma::SubmissionBatcher batcher(fakeHandle<vk::Queue>(1u));
+    std::vector<magma::SemaphoreWait> const waits{{fakeHandle<vk::Semaphore>(1u), vk::PipelineStageFlagBits::eTransfer, 0u, false}};
+    std::vector<magma::SemaphoreSignal> const noSignals;
+
+    recorded = {};
+    batcher.enqueue({}, waits, noSignals);
+    // the batch has no command buffers yet, so they can still wait on more semaphores
+    batcher.enqueue({fakeHandle<vk::CommandBuffer>(1u)}, waits, noSignals);
+    ASSERT_EQ(batcher.getBatchCount(), 1u);
+    batcher.enqueue({fakeHandle<vk::CommandBuffer>(2u)}, waits, noSignals);
+    ASSERT_EQ(batcher.getBatchCount(), 2u);
+    batcher.flush();
+    ASSERT_EQ(recorded.submittedCommandBufferCounts, std::vector<uint32_t>({1u, 1u}));
+}
+
+TEST(submission_batcher, submits_timeline_values_of_zero)
+{
+    magma::SubmissionBatcher batcher(fakeHandle<vk::Queue>(1u));
+    std::vector<magma::SemaphoreWait> const waits{{fakeHandle<vk::Semaphore>(1u), vk::PipelineStageFlagBits::eTransfer, 0u, true}};
+    std::vector<magma::SemaphoreSignal> const noSignals;
+
+    recorded = {};
+    batcher.enqueue({fakeHandle<vk::CommandBuffer>(1u)}, waits, noSignals);
+    batcher.flush();
+    ASSERT_EQ(recorded.submittedTimelineValues, std::vector<bool>({true}));
+}
+
+TEST(submission_batcher, submits_only_what_is_needed)
+{
+    magma::SubmissionBatcher batcher(fakeHandle<vk::Queue>(1u));
+
+    recorded = {};
+    batcher.flush();
+    ASSERT_EQ(recorded.submitCount, 0u);
+    // a fence is signaled even when nothing was enqueued
+    batcher.flush(magma::Fence<claws::no_delete>(fakeHandle<vk::Fence>(1u)));
+    ASSERT_EQ(recorded.submitCount, 1u);
+    ASSERT_TRUE(recorded.submittedCommandBufferCounts.empty());
+}
+
+TEST(frame_graph, culls_passes_without_needed_writes)
+{
+    FakeDevice device;
+    magma::FrameGraph frameGraph(magma::Device<claws::no_delete>(device), fakeHandle<vk::PhysicalDevice>(1u));
+    magma::FrameGraph::ImageDesc const desc{vk::Format::eR8G8B8A8Unorm, {16u, 16u}};
+    auto const output(frameGraph.importBuffer(fakeHandle<vk::Buffer>(1u)));
+    auto const transient(frameGraph.createImage(desc));
+    auto const unread(frameGraph.createImage(desc));
+    auto const marked(frameGraph.createImage(desc));
+    auto const record([](magma::PrimaryCommandBuffer const &) {});
+    auto const produce(frameGraph.addPass(record));
+    auto const consume(frameGraph.addPass(record));
+    auto const dead(frameGraph.addPass(record));
+    auto const markedPass(frameGraph.addPass(record));
+
+    recorded = {};
+    frameGraph.writeStorageImage(produce, transient);
+    frameGraph.readImage(consume, transient, vk::PipelineStageFlagBits::eComputeShader);
+    frameGraph.writeBuffer(consume, output, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite);
+    frameGraph.writeStorageImage(dead, unread);
+    frameGraph.writeStorageImage(markedPass, marked);
+    frameGraph.markOutput(marked);
+    frameGraph.compile();
+    ASSERT_TRUE(frameGraph.isAlive(produce));
+    ASSERT_TRUE(frameGraph.isAlive(consume));
+    ASSERT_FALSE(frameGraph.isAlive(dead));
+    ASSERT_TRUE(frameGraph.isAlive(markedPass));
+    // images only used by culled passes are never created
+    ASSERT_EQ(recorded.imageExtents.size(), 2u);
+    ASSERT_TRUE(frameGraph.getImageView(transient));
+    ASSERT_FALSE(frameGraph.getImageView(unread));
+    ASSERT_TRUE(frameGraph.getImageView(marked));
+}
+
+TEST(frame_graph, aliases_images_with_disjoint_lifetimes)
+{
+    FakeDevice device;
+    magma::FrameGraph frameGraph(magma::Device<claws::no_delete>(device), fakeHandle<vk::PhysicalDevice>(1u));
+    auto const output(frameGraph.importBuffer(fakeHandle<vk::Buffer>(1u)));
+    auto const first(frameGraph.createImage({vk::Format::eR8G8B8A8Unorm, {64u, 64u}}));
+    auto const second(frameGraph.createImage({vk::Format::eR8G8B8A8Unorm, {64u, 64u}}));
+    auto const third(frameGraph.createImage({vk::Format::eR8G8B8A8Unorm, {32u, 32u}}));
+    auto const record([](magma::PrimaryCommandBuffer const &) {});
+    std::vector<magma::FrameGraph::PassId> passes;
+
+    recorded = {};
+    for (uint32_t i(0u); i < 4u; ++i)
+        passes.push_back(frameGraph.addPass(record));
+    frameGraph.writeStorageImage(passes[0], first);
+    frameGraph.readImage(passes[1], first, vk::PipelineStageFlagBits::eComputeShader);
+    frameGraph.writeStorageImage(passes[1], second);
+    frameGraph.readImage(passes[2], second, vk::PipelineStageFlagBits::eComputeShader);
+    frameGraph.writeStorageImage(passes[2], third);
+    frameGraph.readImage(passes[3], third, vk::PipelineStageFlagBits::eComputeShader);
+    frameGraph.writeBuffer(passes[3], output, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite);
+    frameGraph.compile();
+    ASSERT_EQ(recorded.imageExtents.size(), 3u);
+    // the third image is only used once the first one is dead, so it takes its memory
+    ASSERT_EQ(recorded.allocationSizes, std::vector<VkDeviceSize>({64u * 64u * 4u, 64u * 64u * 4u}));
+    ASSERT_EQ(recorded.imageMemories.size(), 3u);
+    ASSERT_EQ(recorded.imageMemories[0], recorded.imageMemories[2]);
+    ASSERT_NE(recorded.imageMemories[0], recorded.imageMemories[1]);
+}
+
+TEST(frame_graph, retires_the_previous_compilation)
+{
+    FakeDevice device;
+    magma::DeletionQueue deletionQueue(magma::Device<claws::no_delete>(device));
+    magma::FrameGraph frameGraph(magma::Device<claws::no_delete>(device), fakeHandle<vk::PhysicalDevice>(1u));
+    auto const image(frameGraph.createImage({vk::Format::eR8G8B8A8Unorm, {16u, 16u}}));
+    auto const pass(frameGraph.addPass([](magma::PrimaryCommandBuffer const &) {}));
+
+    recorded = {};
+    frameGraph.writeStorageImage(pass, image);
+    frameGraph.markOutput(image);
+    frameGraph.compile();
+    ASSERT_EQ(recorded.waitIdleCount, 0u);
+    // without a deletion queue, the previous image and memory are only destroyed once the device is idle
+    frameGraph.compile();
+    ASSERT_EQ(recorded.waitIdleCount, 1u);
+    frameGraph.setDeletionQueue(&deletionQueue);
+    frameGraph.compile();
+    ASSERT_EQ(recorded.waitIdleCount, 1u);
+    ASSERT_EQ(recorded.allocationSizes.size(), 3u);
+}
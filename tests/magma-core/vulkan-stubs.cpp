@@ -0,0 +1,147 @@
+#include <algorithm>
+
+#include "vulkan-stubs.hpp"
+
+using stubs::recorded;
+
+stubs::Recorded stubs::recorded;
+
+extern "C"
+{
+    VKAPI_ATTR void VKAPI_CALL vkCmdPipelineBarrier(VkCommandBuffer,
+                                                    VkPipelineStageFlags srcStageMask,
+                                                    VkPipelineStageFlags dstStageMask,
+                                                    VkDependencyFlags,
+                                                    uint32_t,
+                                                    VkMemoryBarrier const *,
+                                                    uint32_t bufferMemoryBarrierCount,
+                                                    VkBufferMemoryBarrier const *pBufferMemoryBarriers,
+                                                    uint32_t imageMemoryBarrierCount,
+                                                    VkImageMemoryBarrier const *pImageMemoryBarriers)
+    {
+        ++recorded.pipelineBarrierCount;
+        recorded.srcStages = srcStageMask;
+        recorded.dstStages = dstStageMask;
+        recorded.bufferBarriers.assign(pBufferMemoryBarriers, pBufferMemoryBarriers + bufferMemoryBarrierCount);
+        recorded.imageBarriers.assign(pImageMemoryBarriers, pImageMemoryBarriers + imageMemoryBarrierCount);
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkCmdBindPipeline(VkCommandBuffer, VkPipelineBindPoint, VkPipeline)
+    {
+        ++recorded.bindCount;
+    }
+
+    VKAPI_ATTR void VKAPI_CALL
+    vkCmdBindDescriptorSets(VkCommandBuffer, VkPipelineBindPoint, VkPipelineLayout, uint32_t, uint32_t, VkDescriptorSet const *, uint32_t, uint32_t const *)
+    {
+        ++recorded.bindCount;
+    }
+
+    VKAPI_ATTR void VKAPI_CALL
+    vkCmdBindVertexBuffers(VkCommandBuffer, uint32_t firstBinding, uint32_t bindingCount, VkBuffer const *, VkDeviceSize const *)
+    {
+        ++recorded.bindCount;
+        recorded.firstVertexBinding = firstBinding;
+        recorded.vertexBindingCount = bindingCount;
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkCmdBindIndexBuffer(VkCommandBuffer, VkBuffer, VkDeviceSize, VkIndexType)
+    {
+        ++recorded.bindCount;
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkCmdPushConstants(VkCommandBuffer, VkPipelineLayout, VkShaderStageFlags, uint32_t, uint32_t, void const *)
+    {
+        ++recorded.bindCount;
+    }
+
+    VKAPI_ATTR VkResult VKAPI_CALL vkQueueSubmit(VkQueue, uint32_t submitCount, VkSubmitInfo const *pSubmits, VkFence)
+    {
+        ++recorded.submitCount;
+        for (uint32_t i(0u); i < submitCount; ++i)
+        {
+            recorded.submittedCommandBufferCounts.push_back(pSubmits[i].commandBufferCount);
+            recorded.submittedTimelineValues.push_back(pSubmits[i].pNext != nullptr);
+        }
+        return VK_SUCCESS;
+    }
+
+    // images and memories are numbered from 1 in creation order
+    VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice, VkImageCreateInfo const *pCreateInfo, VkAllocationCallbacks const *, VkImage *pImage)
+    {
+        recorded.imageExtents.push_back(pCreateInfo->extent);
+        *pImage = reinterpret_cast<VkImage>(std::uintptr_t(recorded.imageExtents.size()));
+        return VK_SUCCESS;
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice, VkImage, VkAllocationCallbacks const *)
+    {
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements *pMemoryRequirements)
+    {
+        VkExtent3D const &extent(recorded.imageExtents[reinterpret_cast<std::uintptr_t>(image) - 1u]);
+
+        *pMemoryRequirements = {VkDeviceSize(extent.width) * extent.height * 4u, 256u, 1u};
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties *pMemoryProperties)
+    {
+        *pMemoryProperties = {};
+        pMemoryProperties->memoryTypeCount = 1u;
+        pMemoryProperties->memoryTypes[0] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0u};
+        pMemoryProperties->memoryHeapCount = 1u;
+        pMemoryProperties->memoryHeaps[0] = {VkDeviceSize(1u) << 30u, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+    }
+
+    VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, VkMemoryAllocateInfo const *pAllocateInfo, VkAllocationCallbacks const *, VkDeviceMemory *pMemory)
+    {
+        recorded.allocationSizes.push_back(pAllocateInfo->allocationSize);
+        *pMemory = reinterpret_cast<VkDeviceMemory>(std::uintptr_t(recorded.allocationSizes.size()));
+        return VK_SUCCESS;
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory, VkAllocationCallbacks const *)
+    {
+    }
+
+    VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage image, VkDeviceMemory memory, VkDeviceSize)
+    {
+        std::size_t const index(reinterpret_cast<std::uintptr_t>(image) - 1u);
+
+        recorded.imageMemories.resize(std::max(recorded.imageMemories.size(), index + 1u));
+        recorded.imageMemories[index] = memory;
+        return VK_SUCCESS;
+    }
+
+    VKAPI_ATTR VkResult VKAPI_CALL vkCreateImageView(VkDevice, VkImageViewCreateInfo const *pCreateInfo, VkAllocationCallbacks const *, VkImageView *pView)
+    {
+        *pView = reinterpret_cast<VkImageView>(pCreateInfo->image);
+        return VK_SUCCESS;
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkDestroyImageView(VkDevice, VkImageView, VkAllocationCallbacks const *)
+    {
+    }
+
+    VKAPI_ATTR VkResult VKAPI_CALL vkCreateRenderPass(VkDevice, VkRenderPassCreateInfo const *, VkAllocationCallbacks const *, VkRenderPass *pRenderPass)
+    {
+        ++recorded.renderPassCount;
+        *pRenderPass = reinterpret_cast<VkRenderPass>(std::uintptr_t(recorded.renderPassCount));
+        return VK_SUCCESS;
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkDestroyRenderPass(VkDevice, VkRenderPass, VkAllocationCallbacks const *)
+    {
+    }
+
+    VKAPI_ATTR void VKAPI_CALL vkDestroyFramebuffer(VkDevice, VkFramebuffer, VkAllocationCallbacks const *)
+    {
+    }
+
+    VKAPI_ATTR VkResult VKAPI_CALL vkDeviceWaitIdle(VkDevice)
+    {
+        ++recorded.waitIdleCount;
+        return VK_SUCCESS;
+    }
+}
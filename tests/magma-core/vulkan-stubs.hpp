@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "magma/Device.hpp"
+
+// The Vulkan commands magma calls from the tests are all defined in vulkan-stubs.cpp,
+// recording their parameters instead of reaching a driver, as the tests don't link the Vulkan loader
+namespace stubs
+{
+    struct Recorded
+    {
+        std::size_t pipelineBarrierCount;
+        VkPipelineStageFlags srcStages;
+        VkPipelineStageFlags dstStages;
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        std::size_t bindCount;
+        uint32_t firstVertexBinding;
+        uint32_t vertexBindingCount;
+        std::size_t submitCount;
+        std::vector<uint32_t> submittedCommandBufferCounts;
+        std::vector<bool> submittedTimelineValues;
+        std::vector<VkExtent3D> imageExtents;
+        std::vector<VkDeviceSize> allocationSizes;
+        std::vector<VkDeviceMemory> imageMemories;
+        std::size_t renderPassCount;
+        std::size_t waitIdleCount;
+    };
+
+    extern Recorded recorded;
+
+    template<class Handle>
+    Handle fakeHandle(std::uintptr_t value)
+    {
+        return Handle(reinterpret_cast<typename Handle::CType>(value));
+    }
+
+    struct FakeDevice : magma::impl::Device
+    {
+        FakeDevice()
+        {
+            static_cast<vk::Device &>(*this) = fakeHandle<vk::Device>(1u);
+        }
+    };
+};